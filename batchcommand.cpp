@@ -0,0 +1,107 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "batchcommand.h"
+#include "pipeline.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThread>
+#include <algorithm>
+
+BatchCommand::BatchCommand()
+ : ThreadCount(QThread::idealThreadCount()), Elapsed(0)
+{
+}
+
+BatchCommand::~BatchCommand()
+{
+}
+
+QStringList BatchCommand::findFiles(const QString& source, const QStringList& namefilters)
+{
+	QStringList filenames;
+	if(QFileInfo(source).isFile())
+	{
+		filenames.append(QFileInfo(source).absoluteFilePath());
+		return filenames;
+	}
+
+	QDirIterator entry(source, namefilters, QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+	while(entry.hasNext())
+		filenames.append(entry.next());
+
+	// Makes the output and any errors come out in a predictable order.
+	filenames.sort();
+	return filenames;
+}
+
+void BatchCommand::runAll(int count)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	Pipeline pipeline(this);
+	pipeline.run(count);
+
+	Elapsed = timer.elapsed();
+	Utilisation = pipeline.utilisation();
+}
+
+int BatchCommand::stageThreads(int stage)
+{
+	// Reading and writing wait on the disk, two threads each keep it busy.
+	// The other stages get the requested number of threads each, a stage
+	// that has nothing to do just sleeps.
+	if(stage == Pipeline::Read || stage == Pipeline::Write)
+		return 2;
+	else
+		return std::max(1, ThreadCount);
+}
+
+bool BatchCommand::write(batchitem_t* item)
+{
+	for(int i = 0; i < item->Outputs.count(); i++)
+	{
+		const QString& filename = item->OutputNames[i];
+		QDir().mkpath(QFileInfo(filename).absolutePath());
+
+		QFile file(filename);
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(item->Outputs[i]) != item->Outputs[i].length())
+		{
+			addError(filename, file.errorString());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void BatchCommand::addError(const QString& filename, const QString& error)
+{
+	QMutexLocker locker(&Mutex);
+	Errors.append(QString("%1: %2").arg(filename).arg(error));
+}
+
+double BatchCommand::seconds()
+{
+	return std::max(Elapsed, (qint64)1) / 1000.;
+}
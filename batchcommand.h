@@ -0,0 +1,64 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCHCOMMAND_H
+#define BATCHCOMMAND_H
+
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+
+struct batchitem_t;
+
+// Base for the papatool commands that do the same thing to a lot of files.
+// Each file goes through the stages of a Pipeline, these are called from
+// its threads. A stage returns false to drop the file, after adding an
+// error.
+class BatchCommand
+{
+public:
+	BatchCommand();
+	virtual ~BatchCommand();
+	void setThreadCount(int threads) {ThreadCount = threads;}
+	QStringList errors() {return Errors;}
+	QString utilisation() {return Utilisation;}
+	virtual QString summary() = 0;
+	virtual int stageThreads(int stage);
+
+	virtual bool read(batchitem_t *item) = 0;
+	virtual bool decode(batchitem_t *item) {Q_UNUSED(item); return true;}
+	virtual bool transform(batchitem_t *item) {Q_UNUSED(item); return true;}
+	virtual bool encode(batchitem_t *item) {Q_UNUSED(item); return true;}
+	virtual bool write(batchitem_t *item);
+
+	static QStringList findFiles(const QString& source, const QStringList& namefilters);
+
+protected:
+	void runAll(int count);
+	void addError(const QString& filename, const QString& error);
+	double seconds();
+
+	int ThreadCount;
+	QMutex Mutex;
+	QStringList Errors;
+	QString Utilisation;
+	qint64 Elapsed;
+};
+
+#endif // BATCHCOMMAND_H
@@ -0,0 +1,197 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "batchexporter.h"
+#include "papafile.h"
+#include "pipeline.h"
+#include <QDir>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageWriter>
+#include <QtEndian>
+#include <algorithm>
+
+BatchExporter::BatchExporter()
+ : Mipmaps(false), Format("png"), Files(0), Images(0), BytesRead(0), BytesWritten(0)
+{
+}
+
+bool BatchExporter::run(const QString& source, const QString& destination)
+{
+	Source = QFileInfo(source).isFile() ? QFileInfo(source).absolutePath() : QDir(source).absolutePath();
+	Destination = QDir(destination).absolutePath();
+	if(!QDir().mkpath(Destination))
+	{
+		Errors.append(QString("Couldn't create %1").arg(Destination));
+		return false;
+	}
+
+	Filenames = findFiles(source, QStringList("*.papa"));
+	runAll(Filenames.count());
+	return Errors.isEmpty();
+}
+
+bool BatchExporter::read(batchitem_t* item)
+{
+	const QString& filename = Filenames[item->Index];
+	item->Papa = new PapaFile(filename);
+	if(!item->Papa->isValid() || !item->Papa->preload())
+	{
+		addError(filename, item->Papa->lastError());
+		return false;
+	}
+
+	return true;
+}
+
+bool BatchExporter::decode(batchitem_t* item)
+{
+	// Mirrors the source tree, with the mipmaps and any extra textures next
+	// to the first one.
+	const QString& filename = Filenames[item->Index];
+	QString relative = QDir(Source).relativeFilePath(filename);
+	QString base = Destination + '/' + relative.left(relative.length() - QFileInfo(relative).suffix().length() - 1);
+
+	PapaFile *papa = item->Papa;
+	for(int t = 0; t < papa->textureCount(); t++)
+	{
+		int mipcount = Mipmaps ? papa->mipCount(t) : std::min(1, papa->mipCount(t));
+		for(int m = 0; m < mipcount; m++)
+		{
+			QImage image = papa->mipmap(t, m);
+			if(image.isNull())
+			{
+				addError(filename, papa->lastError());
+				return false;
+			}
+
+			QString imagename = base;
+			if(t > 0)
+				imagename += QString("_%1").arg(t);
+			if(m > 0)
+				imagename += QString(".mip%1").arg(m);
+			imagename += '.' + Format;
+			item->Images.append(image);
+			item->OutputNames.append(imagename);
+		}
+	}
+
+	// The decoded images are all that's needed from here on.
+	delete item->Papa;
+	item->Papa = NULL;
+	return true;
+}
+
+bool BatchExporter::encode(batchitem_t* item)
+{
+	for(int i = 0; i < item->Images.count(); i++)
+	{
+		QByteArray data;
+		QString error;
+		if(!encodeImage(item->Images[i], Format, data, error))
+		{
+			addError(item->OutputNames[i], error);
+			return false;
+		}
+		item->Outputs.append(data);
+	}
+	item->Images.clear();
+
+	return true;
+}
+
+bool BatchExporter::write(batchitem_t* item)
+{
+	if(!BatchCommand::write(item))
+		return false;
+
+	qint64 written = 0;
+	for(int i = 0; i < item->Outputs.count(); i++)
+		written += item->Outputs[i].length();
+
+	QMutexLocker locker(&Mutex);
+	Files++;
+	Images += item->Outputs.count();
+	BytesRead += QFileInfo(Filenames[item->Index]).size();
+	BytesWritten += written;
+	return true;
+}
+
+bool BatchExporter::encodeImage(const QImage& image, const QString& format, QByteArray& data, QString& error)
+{
+	// Qt 4 has no TGA plugin at all, so that one is written here.
+	if(format.toLower() == "tga")
+	{
+		encodeTga(image, data);
+		return true;
+	}
+
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+	QImageWriter writer(&buffer, format.toLower().toAscii());
+	if(!writer.write(image))
+	{
+		error = writer.errorString();
+		return false;
+	}
+
+	return true;
+}
+
+void BatchExporter::encodeTga(const QImage& image, QByteArray& data)
+{
+	// Uncompressed 32 bit true colour: BGRA pixels with 8 bits of alpha,
+	// top row first (descriptor 0x28).
+	uchar header[18] = {0};
+	header[2] = 2;
+	qToLittleEndian<quint16>(image.width(), header + 12);
+	qToLittleEndian<quint16>(image.height(), header + 14);
+	header[16] = 32;
+	header[17] = 0x28;
+
+	QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+	data.clear();
+	data.reserve(sizeof(header) + 4 * argb.width() * argb.height());
+	data.append((const char *)header, sizeof(header));
+	for(int y = 0; y < argb.height(); y++)
+	{
+		const QRgb *line = (const QRgb *)argb.constScanLine(y);
+		for(int x = 0; x < argb.width(); x++)
+		{
+			data.append(qBlue(line[x]));
+			data.append(qGreen(line[x]));
+			data.append(qRed(line[x]));
+			data.append(qAlpha(line[x]));
+		}
+	}
+}
+
+QString BatchExporter::summary()
+{
+	double seconds = this->seconds();
+	return QString("Exported %1 files (%2 images) in %3 s: %4 files/s, %5 MB/s read, %6 MB/s written, %7 failed")
+		.arg(Files)
+		.arg(Images)
+		.arg(seconds, 0, 'f', 2)
+		.arg(Files / seconds, 0, 'f', 1)
+		.arg(BytesRead / seconds / (1024 * 1024), 0, 'f', 1)
+		.arg(BytesWritten / seconds / (1024 * 1024), 0, 'f', 1)
+		.arg(Errors.count());
+}
@@ -0,0 +1,57 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCHEXPORTER_H
+#define BATCHEXPORTER_H
+
+#include "batchcommand.h"
+
+class QImage;
+
+class BatchExporter : public BatchCommand
+{
+public:
+	BatchExporter();
+	void setMipmaps(bool mipmaps) {Mipmaps = mipmaps;}
+	void setFormat(const QString& format) {Format = format;}
+	bool run(const QString& source, const QString& destination);
+	virtual QString summary();
+	virtual bool read(batchitem_t *item);
+	virtual bool decode(batchitem_t *item);
+	virtual bool encode(batchitem_t *item);
+	virtual bool write(batchitem_t *item);
+
+	static bool encodeImage(const QImage& image, const QString& format, QByteArray& data, QString& error);
+
+private:
+	static void encodeTga(const QImage& image, QByteArray& data);
+
+	bool Mipmaps;
+	QString Format;
+	QString Source;
+	QString Destination;
+	QStringList Filenames;
+
+	int Files;
+	int Images;
+	qint64 BytesRead;
+	qint64 BytesWritten;
+};
+
+#endif // BATCHEXPORTER_H
@@ -0,0 +1,390 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "batchimporter.h"
+#include "papafile.h"
+#include "pipeline.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QPair>
+#include <QtAlgorithms>
+#include <QCryptographicHash>
+
+BatchImporter::BatchImporter()
+ : DryRun(false), Unmatched(0), UpToDate(0)
+{
+}
+
+bool BatchImporter::runDirectories(const QString& images, const QString& papas)
+{
+	// Every texture that has an image at the same place in the image tree,
+	// in any format Qt can read.
+	QList<QByteArray> formats = QImageReader::supportedImageFormats();
+	QDir papadir(QFileInfo(papas).isFile() ? QFileInfo(papas).absolutePath() : papas);
+	QDir imagedir(images);
+	QStringList filenames = findFiles(papas, QStringList("*.papa"));
+	for(QStringList::const_iterator filename = filenames.constBegin(); filename != filenames.constEnd(); ++filename)
+	{
+		QString relative = papadir.relativeFilePath(*filename);
+		QString base = imagedir.absoluteFilePath(relative.left(relative.length() - QFileInfo(relative).suffix().length() - 1));
+
+		import_t import;
+		for(QList<QByteArray>::const_iterator format = formats.constBegin(); format != formats.constEnd(); ++format)
+		{
+			QString imagename = base + '.' + QString(*format).toLower();
+			if(QFileInfo(imagename).exists())
+			{
+				import.Image = imagename;
+				import.Papa = *filename;
+				break;
+			}
+		}
+
+		if(import.Image.isEmpty())
+			Unmatched++;
+		else
+			Imports.append(import);
+	}
+
+	return run();
+}
+
+bool BatchImporter::runManifest(const QString& manifest)
+{
+	QFile file(manifest);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		Errors.append(QString("%1: %2").arg(manifest).arg(file.errorString()));
+		return false;
+	}
+
+	// One "image<tab>papa" pair per line, relative to the manifest.
+	QDir manifestdir = QFileInfo(manifest).absoluteDir();
+	QTextStream stream(&file);
+	int linenumber = 0;
+	while(!stream.atEnd())
+	{
+		QString line = stream.readLine();
+		linenumber++;
+		if(line.trimmed().isEmpty() || line.trimmed().startsWith('#'))
+			continue;
+
+		QStringList fields = line.split('\t');
+		if(fields.count() != 2)
+		{
+			Errors.append(QString("%1:%2: expected an image and a papa file separated by a tab").arg(manifest).arg(linenumber));
+			continue;
+		}
+
+		import_t import;
+		import.Image = manifestdir.absoluteFilePath(fields[0].trimmed());
+		import.Papa = manifestdir.absoluteFilePath(fields[1].trimmed());
+		Imports.append(import);
+	}
+
+	if(!Errors.isEmpty())
+		return false;
+
+	return run();
+}
+
+bool BatchImporter::run()
+{
+	EncodeTimes.clear();
+	for(int i = 0; i < Imports.count(); i++)
+		EncodeTimes.append(-1);
+
+	if(!StateFilename.isEmpty() && !loadState())
+		return false;
+	runAll(Imports.count());
+	if(!StateFilename.isEmpty() && !DryRun && !saveState())
+		return false;
+
+	return Errors.isEmpty();
+}
+
+bool BatchImporter::loadState()
+{
+	// There's no state before the first build, which builds everything.
+	QFile file(StateFilename);
+	if(!file.exists())
+		return true;
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		Errors.append(QString("%1: %2").arg(StateFilename).arg(file.errorString()));
+		return false;
+	}
+
+	// One "papa<tab>image hash<tab>settings<tab>papa hash" line per texture,
+	// with the papa file relative to the state file.
+	QDir statedir = QFileInfo(StateFilename).absoluteDir();
+	QTextStream stream(&file);
+	while(!stream.atEnd())
+	{
+		QString line = stream.readLine();
+		if(line.isEmpty() || line.startsWith('#'))
+			continue;
+
+		QStringList fields = line.split('\t');
+		if(fields.count() != 4)
+			continue;
+
+		buildentry_t entry;
+		entry.ImageHash = QByteArray::fromHex(fields[1].toAscii());
+		entry.Settings = fields[2];
+		entry.PapaHash = QByteArray::fromHex(fields[3].toAscii());
+		State.insert(QDir::cleanPath(statedir.absoluteFilePath(fields[0])), entry);
+	}
+
+	return true;
+}
+
+bool BatchImporter::saveState()
+{
+	// Textures that weren't part of this build keep their entries, the ones
+	// that failed lose them so they get another go next time.
+	QHash<QString, buildentry_t> state = State;
+	for(int i = 0; i < Imports.count(); i++)
+	{
+		if(EncodeTimes[i] < 0)
+			state.remove(QDir::cleanPath(Imports[i].Papa));
+	}
+	for(QHash<QString, buildentry_t>::const_iterator entry = Built.constBegin(); entry != Built.constEnd(); ++entry)
+		state.insert(entry.key(), entry.value());
+
+	QStringList papas = state.keys();
+	papas.sort();
+
+	// Written next to the old one first, so a crash can't leave half a state.
+	QDir statedir = QFileInfo(StateFilename).absoluteDir();
+	QFile file(StateFilename + ".new");
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		Errors.append(QString("%1: %2").arg(file.fileName()).arg(file.errorString()));
+		return false;
+	}
+	QTextStream stream(&file);
+	stream << "# papatool build state\n";
+	for(QStringList::const_iterator papa = papas.constBegin(); papa != papas.constEnd(); ++papa)
+	{
+		const buildentry_t& entry = state[*papa];
+		stream << statedir.relativeFilePath(*papa) << '\t' << entry.ImageHash.toHex() << '\t' << entry.Settings << '\t' << entry.PapaHash.toHex() << '\n';
+	}
+	stream.flush();
+	file.close();
+
+	QFile::remove(StateFilename);
+	if(file.error() != QFile::NoError || !file.rename(StateFilename))
+	{
+		Errors.append(QString("%1: %2").arg(StateFilename).arg(file.errorString()));
+		return false;
+	}
+
+	return true;
+}
+
+QByteArray BatchImporter::hash(const QByteArray& contents)
+{
+	return QCryptographicHash::hash(contents, QCryptographicHash::Sha1);
+}
+
+QString BatchImporter::settings(PapaFile* papa)
+{
+	// The mipmaps are always regenerated, so the format and the encoder are
+	// all that decides what comes out.
+	return QString("%1/%2").arg(papa->format()).arg(PapaFile::EncoderVersion);
+}
+
+bool BatchImporter::read(batchitem_t* item)
+{
+	const import_t& import = Imports.at(item->Index);
+
+	item->Papa = new PapaFile(import.Papa);
+	if(!item->Papa->isValid())
+	{
+		addError(import.Papa, item->Papa->lastError());
+		return false;
+	}
+	if(!item->Papa->canEncode())
+	{
+		addError(import.Papa, QString("Can't encode %1 textures yet").arg(item->Papa->format()));
+		return false;
+	}
+
+	QFile file(import.Image);
+	if(!file.open(QIODevice::ReadOnly))
+	{
+		addError(import.Image, file.errorString());
+		return false;
+	}
+	item->Input = file.readAll();
+
+	// An incremental build skips the texture if the image and the settings
+	// are the same as last time and nobody changed the papa file since.
+	if(!StateFilename.isEmpty())
+	{
+		item->InputHash = hash(item->Input);
+		QHash<QString, buildentry_t>::const_iterator entry = State.constFind(QDir::cleanPath(import.Papa));
+		if(entry != State.constEnd() && entry->ImageHash == item->InputHash && entry->Settings == settings(item->Papa))
+		{
+			QFile papa(import.Papa);
+			if(papa.open(QIODevice::ReadOnly) && hash(papa.readAll()) == entry->PapaHash)
+			{
+				QMutexLocker locker(&Mutex);
+				UpToDate++;
+				Built.insert(entry.key(), entry.value());
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool BatchImporter::decode(batchitem_t* item)
+{
+	const import_t& import = Imports.at(item->Index);
+
+	QImage image = QImage::fromData(item->Input, QFileInfo(import.Image).suffix().toAscii());
+	item->Input.clear();
+	if(image.isNull())
+	{
+		addError(import.Image, "Couldn't decode the image");
+		return false;
+	}
+	if(image.size() != item->Papa->size(0))
+	{
+		addError(import.Image, QString("Is %1x%2, but %3 is %4x%5").arg(image.width()).arg(image.height()).arg(import.Papa).arg(item->Papa->size(0).width()).arg(item->Papa->size(0).height()));
+		return false;
+	}
+
+	item->Images.append(image);
+	return true;
+}
+
+bool BatchImporter::transform(batchitem_t* item)
+{
+	// Also regenerates the mipmaps from the new image.
+	QElapsedTimer timer;
+	timer.start();
+	bool success = item->Papa->importImage(item->Images[0], 0);
+	item->Images.clear();
+	item->EncodeTime += timer.elapsed();
+
+	if(!success)
+	{
+		addError(Imports.at(item->Index).Papa, item->Papa->lastError());
+		return false;
+	}
+
+	return true;
+}
+
+bool BatchImporter::encode(batchitem_t* item)
+{
+	QElapsedTimer timer;
+	timer.start();
+	QByteArray contents;
+	bool success = item->Papa->encode(contents);
+	item->EncodeTime += timer.elapsed();
+
+	if(!success)
+	{
+		addError(Imports.at(item->Index).Papa, item->Papa->lastError());
+		return false;
+	}
+
+	item->Outputs.append(contents);
+	return true;
+}
+
+bool BatchImporter::write(batchitem_t* item)
+{
+	// A dry run still encodes, so the timings and encoder errors are the
+	// real thing, it just doesn't save the result.
+	const import_t& import = Imports.at(item->Index);
+	if(!DryRun && !item->Papa->store(import.Papa, item->Outputs[0]))
+	{
+		addError(import.Papa, item->Papa->lastError());
+		return false;
+	}
+
+	buildentry_t entry;
+	if(!StateFilename.isEmpty())
+	{
+		entry.ImageHash = item->InputHash;
+		entry.Settings = settings(item->Papa);
+		entry.PapaHash = hash(item->Outputs[0]);
+	}
+
+	QMutexLocker locker(&Mutex);
+	EncodeTimes[item->Index] = item->EncodeTime;
+	if(!StateFilename.isEmpty())
+		Built.insert(QDir::cleanPath(import.Papa), entry);
+	return true;
+}
+
+QStringList BatchImporter::timings()
+{
+	// Slowest first.
+	QList<QPair<qint64, QString> > sorted;
+	for(int i = 0; i < Imports.count(); i++)
+	{
+		if(EncodeTimes[i] >= 0)
+			sorted.append(qMakePair(EncodeTimes[i], Imports[i].Papa));
+	}
+	qSort(sorted.begin(), sorted.end(), qGreater<QPair<qint64, QString> >());
+
+	QStringList lines;
+	for(QList<QPair<qint64, QString> >::const_iterator timing = sorted.constBegin(); timing != sorted.constEnd(); ++timing)
+		lines.append(QString("%1 ms\t%2").arg(timing->first).arg(timing->second));
+
+	return lines;
+}
+
+QString BatchImporter::summary()
+{
+	int imported = 0;
+	qint64 encodetime = 0;
+	for(int i = 0; i < EncodeTimes.count(); i++)
+	{
+		if(EncodeTimes[i] >= 0)
+		{
+			imported++;
+			encodetime += EncodeTimes[i];
+		}
+	}
+
+	QString summary = QString("%1 %2 of %3 files in %4 s (%5 without a matching image), average encode time %6 ms, %7 failed")
+		.arg(DryRun ? "Would have imported" : "Imported")
+		.arg(imported)
+		.arg(Imports.count())
+		.arg(seconds(), 0, 'f', 2)
+		.arg(Unmatched)
+		.arg(imported > 0 ? encodetime / imported : 0)
+		.arg(Errors.count());
+	if(!StateFilename.isEmpty())
+		summary += QString(", %1 up to date").arg(UpToDate);
+
+	return summary;
+}
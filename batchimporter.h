@@ -0,0 +1,77 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCHIMPORTER_H
+#define BATCHIMPORTER_H
+
+#include "batchcommand.h"
+#include <QList>
+#include <QHash>
+
+class PapaFile;
+
+class BatchImporter : public BatchCommand
+{
+public:
+	BatchImporter();
+	void setDryRun(bool dryrun) {DryRun = dryrun;}
+	void setBuildState(const QString& filename) {StateFilename = filename;}
+	bool runDirectories(const QString& images, const QString& papas);
+	bool runManifest(const QString& manifest);
+	virtual QString summary();
+	virtual bool read(batchitem_t *item);
+	virtual bool decode(batchitem_t *item);
+	virtual bool transform(batchitem_t *item);
+	virtual bool encode(batchitem_t *item);
+	virtual bool write(batchitem_t *item);
+	QStringList timings();
+
+private:
+	struct import_t
+	{
+		QString Image;
+		QString Papa;
+	};
+
+	// What went into and came out of the last build of a papa file.
+	struct buildentry_t
+	{
+		QByteArray ImageHash;
+		QString Settings;
+		QByteArray PapaHash;
+	};
+
+	bool run();
+	bool loadState();
+	bool saveState();
+	static QByteArray hash(const QByteArray& contents);
+	static QString settings(PapaFile *papa);
+
+	bool DryRun;
+	QList<import_t> Imports;
+	QList<qint64> EncodeTimes; // Milliseconds, -1 if it failed
+	int Unmatched;
+
+	QString StateFilename; // Empty unless this is an incremental build
+	QHash<QString, buildentry_t> State; // From the last build, by papa file
+	QHash<QString, buildentry_t> Built;
+	int UpToDate;
+};
+
+#endif // BATCHIMPORTER_H
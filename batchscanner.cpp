@@ -0,0 +1,195 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "batchscanner.h"
+#include "papafile.h"
+#include "pipeline.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QStringList>
+#include <algorithm>
+
+BatchScanner::BatchScanner()
+ : Format(JsonLines), Textures(0)
+{
+}
+
+bool BatchScanner::run(const QString& source, QIODevice* output)
+{
+	Source = QFileInfo(source).isFile() ? QFileInfo(source).absolutePath() : QDir(source).absolutePath();
+	Filenames = findFiles(source, QStringList("*.papa"));
+	Lines.fill(QString(), Filenames.count());
+	runAll(Filenames.count());
+
+	// Written in the order of the file names, so two inventories diff well.
+	if(Format == Csv)
+		output->write("file,size,error,bones,sections,header_unknowns,texture,format,width,height,mipmaps,srgb,unknown1,unknown2,unknown3,length\n");
+	for(int i = 0; i < Lines.count(); i++)
+		output->write(Lines[i].toUtf8());
+
+	return Errors.isEmpty();
+}
+
+int BatchScanner::stageThreads(int stage)
+{
+	// All the work is opening files and reading a few bytes from them, so it
+	// takes lots of requests in flight to keep the disk busy.
+	if(stage == Pipeline::Read)
+		return 4 * std::max(1, ThreadCount);
+	else
+		return 1;
+}
+
+bool BatchScanner::read(batchitem_t* item)
+{
+	const QString& filename = Filenames[item->Index];
+	QString relative = QDir(Source).relativeFilePath(filename);
+	qint64 size = QFileInfo(filename).size();
+
+	PapaFile::info_t info;
+	QString error;
+	bool success = PapaFile::inspect(filename, info, error);
+	if(!success)
+		addError(filename, error);
+
+	QString line;
+	if(Format == JsonLines)
+		line = jsonRecord(relative, size, info, error) + '\n';
+	else
+	{
+		// One row per texture, the file's columns repeat.
+		// Names from the files may hold a %1 themselves, so they are never
+		// followed by another arg().
+		QString file = csvField(relative) + ',' + QString::number(size) + ',' + csvField(error) + ',';
+		if(success)
+			file += QString("%1,%2,%3,").arg(csvField(info.Bones.join("|")), csvField(info.Sections.join("|")), headerUnknowns(info, " "));
+		else
+			file += ",,,";
+
+		if(info.Textures.isEmpty() || !success)
+			line = file + ",,,,,,,,,\n";
+		for(int i = 0; success && i < info.Textures.count(); i++)
+		{
+			const PapaFile::textureinfo_t& texture = info.Textures[i];
+			line += file + QString("%1,%2,%3,%4,%5,%6,%7 %8,%9,%10,%11\n")
+				.arg(i)
+				.arg(PapaFile::formatName(texture.Format))
+				.arg(texture.Width)
+				.arg(texture.Height)
+				.arg(texture.Mipmaps)
+				.arg(texture.SRGB ? 1 : 0)
+				.arg(texture.Unknown1[0])
+				.arg(texture.Unknown1[1])
+				.arg(texture.Unknown2)
+				.arg(texture.Unknown3)
+				.arg(texture.Length);
+		}
+	}
+
+	QMutexLocker locker(&Mutex);
+	Lines[item->Index] = line;
+	Textures += info.Textures.count();
+	return true;
+}
+
+QString BatchScanner::summary()
+{
+	return QString("Scanned %1 files (%2 textures) in %3 s: %4 files/s, %5 failed")
+		.arg(Filenames.count())
+		.arg(Textures)
+		.arg(seconds(), 0, 'f', 2)
+		.arg(Filenames.count() / seconds(), 0, 'f', 0)
+		.arg(Errors.count());
+}
+
+QString BatchScanner::jsonRecord(const QString& file, qint64 size, const PapaFile::info_t& info, const QString& error)
+{
+	// An empty error means the headers were read.
+	QString line = "{\"file\":" + jsonString(file) + ",\"size\":" + QString::number(size);
+	if(error.isEmpty())
+	{
+		QStringList bones;
+		for(int i = 0; i < info.Bones.count(); i++)
+			bones.append(jsonString(info.Bones[i]));
+		QStringList sections;
+		for(int i = 0; i < info.Sections.count(); i++)
+			sections.append(jsonString(info.Sections[i]));
+		QStringList textures;
+		for(int i = 0; i < info.Textures.count(); i++)
+		{
+			const PapaFile::textureinfo_t& texture = info.Textures[i];
+			textures.append(QString("{\"format\":%1,\"format_id\":%2,\"width\":%3,\"height\":%4,\"mipmaps\":%5,\"srgb\":%6,\"unknown1\":[%7,%8],\"unknown2\":%9,\"unknown3\":%10,\"length\":%11}")
+				.arg(jsonString(PapaFile::formatName(texture.Format)))
+				.arg(texture.Format)
+				.arg(texture.Width)
+				.arg(texture.Height)
+				.arg(texture.Mipmaps)
+				.arg(texture.SRGB ? "true" : "false")
+				.arg(texture.Unknown1[0])
+				.arg(texture.Unknown1[1])
+				.arg(texture.Unknown2)
+				.arg(texture.Unknown3)
+				.arg(texture.Length));
+		}
+		line += QString(",\"bones\":[%1],\"sections\":[%2],\"header_unknowns\":[%3],\"textures\":[%4]")
+			.arg(bones.join(","), sections.join(","), headerUnknowns(info, ","), textures.join(","));
+	}
+	else
+		line += QString(",\"error\":%1").arg(jsonString(error));
+	line += '}';
+
+	return line;
+}
+
+QString BatchScanner::jsonString(const QString& text)
+{
+	QString escaped = "\"";
+	for(int i = 0; i < text.length(); i++)
+	{
+		QChar c = text[i];
+		if(c == '"' || c == '\\')
+			escaped += QString('\\') + c;
+		else if(c.unicode() < 0x20)
+			escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+		else
+			escaped += c;
+	}
+	escaped += '"';
+
+	return escaped;
+}
+
+QString BatchScanner::headerUnknowns(const PapaFile::info_t& info, const QString& separator)
+{
+	QStringList values;
+	for(int i = 0; i < 6; i++)
+		values.append(QString::number(info.HeaderUnknowns[i]));
+	return values.join(separator);
+}
+
+QString BatchScanner::csvField(const QString& text)
+{
+	if(!text.contains(',') && !text.contains('"') && !text.contains('\n'))
+		return text;
+
+	QString escaped = text;
+	escaped.replace("\"", "\"\"");
+	return '"' + escaped + '"';
+}
@@ -0,0 +1,59 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCHSCANNER_H
+#define BATCHSCANNER_H
+
+#include "batchcommand.h"
+#include "papafile.h"
+#include <QVector>
+
+class QIODevice;
+
+class BatchScanner : public BatchCommand
+{
+public:
+	enum OutputFormat
+	{
+		JsonLines,
+		Csv
+	};
+
+	BatchScanner();
+	void setOutputFormat(OutputFormat format) {Format = format;}
+	bool run(const QString& source, QIODevice *output);
+	virtual QString summary();
+	virtual int stageThreads(int stage);
+	virtual bool read(batchitem_t *item);
+
+	static QString jsonRecord(const QString& file, qint64 size, const PapaFile::info_t& info, const QString& error);
+
+private:
+	static QString jsonString(const QString& text);
+	static QString csvField(const QString& text);
+	static QString headerUnknowns(const PapaFile::info_t& info, const QString& separator);
+
+	OutputFormat Format;
+	QString Source;
+	QStringList Filenames;
+	QVector<QString> Lines;
+	int Textures;
+};
+
+#endif // BATCHSCANNER_H
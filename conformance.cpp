@@ -0,0 +1,241 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Decodes the textures in conformance/ with every set of kernels the CPU
+// can run, see papakernels.h, and
+// compares the result bit for bit with the golden images next to them,
+// which conformance/generate.py made with its own reference decoders.
+// Each variant has to match exactly, faster isn't allowed to mean
+// different. The files that can be encoded also have to come out of the
+// encoder byte for byte the same as they went in.
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QRunnable>
+#include <QStringList>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QVector>
+#include "papafile.h"
+#include "papakernels.h"
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+// Every set of kernels the CPU can run, one mipmap after the other and
+// all at once.
+struct variant_t
+{
+	QString Name;
+	const PapaKernels::kernels_t *Kernels;
+	bool Threaded;
+};
+
+static QVector<QImage> decodeSequential(PapaFile *papa)
+{
+	QVector<QImage> images(papa->mipCount(0));
+	for(int m = 0; m < images.count(); m++)
+		images[m] = papa->mipmap(0, m);
+	return images;
+}
+
+class MipmapJob : public QRunnable
+{
+public:
+	MipmapJob(PapaFile *papa, int mipindex, QImage *image) : Papa(papa), MipIndex(mipindex), Image(image) {}
+	virtual void run() {*Image = Papa->mipmap(0, MipIndex);}
+
+private:
+	PapaFile *Papa;
+	int MipIndex;
+	QImage *Image;
+};
+
+// Every mipmap at the same time, several times over, like the editor's
+// thumbnail loaders and prefetcher do it. All copies have to agree.
+static QVector<QImage> decodeThreaded(PapaFile *papa)
+{
+	const int copies = 4;
+	int mips = papa->mipCount(0);
+	QVector<QImage> images(copies * mips);
+	QThreadPool pool;
+	pool.setMaxThreadCount(4);
+	for(int i = 0; i < images.count(); i++)
+		pool.start(new MipmapJob(papa, i % mips, &images[i]));
+	pool.waitForDone();
+
+	for(int i = mips; i < images.count(); i++)
+	{
+		if(images[i] != images[i % mips])
+			return QVector<QImage>(mips);
+	}
+	images.resize(mips);
+	return images;
+}
+
+static QList<variant_t> variants()
+{
+	QList<variant_t> variants;
+	QList<const PapaKernels::kernels_t *> kernels = PapaKernels::available();
+	for(int i = 0; i < kernels.count(); i++)
+	{
+		variant_t variant;
+		variant.Name = kernels[i]->Name;
+		variant.Kernels = kernels[i];
+		variant.Threaded = false;
+		variants.append(variant);
+		variant.Name += " threaded";
+		variant.Threaded = true;
+		variants.append(variant);
+	}
+	return variants;
+}
+
+static QString compare(const QImage& decoded, const QImage& golden)
+{
+	if(decoded.isNull())
+		return "decoding failed";
+	if(decoded.size() != golden.size())
+		return QString("is %1x%2, expected %3x%4").arg(decoded.width()).arg(decoded.height()).arg(golden.width()).arg(golden.height());
+
+	QImage actual = decoded.convertToFormat(QImage::Format_ARGB32);
+	QImage expected = golden.convertToFormat(QImage::Format_ARGB32);
+	for(int y = 0; y < expected.height(); y++)
+	{
+		const QRgb *a = (const QRgb *)actual.constScanLine(y);
+		const QRgb *e = (const QRgb *)expected.constScanLine(y);
+		for(int x = 0; x < expected.width(); x++)
+		{
+			if(a[x] != e[x])
+				return QString("pixel %1,%2 is #%3, expected #%4").arg(x).arg(y).arg(a[x], 8, 16, QChar('0')).arg(e[x], 8, 16, QChar('0'));
+		}
+	}
+	return QString();
+}
+
+static bool checkFile(const QString& directory, const QString& name)
+{
+	bool success = true;
+	QString filename = QDir(directory).filePath(name + ".papa");
+	PapaFile papa;
+	if(!papa.load(filename))
+	{
+		err << name << ": " << papa.lastError() << endl;
+		return false;
+	}
+
+	QList<QImage> golden;
+	for(int m = 0; m < papa.mipCount(0); m++)
+	{
+		QImage image(QDir(directory).filePath(QString("%1.mip%2.png").arg(name).arg(m)));
+		if(image.isNull())
+		{
+			err << name << ": no golden image for mipmap " << m << endl;
+			return false;
+		}
+		golden.append(image);
+	}
+
+	QList<variant_t> tested = variants();
+	for(QList<variant_t>::const_iterator variant = tested.constBegin(); variant != tested.constEnd(); ++variant)
+	{
+		PapaKernels::select(variant->Kernels->Name);
+		QVector<QImage> decoded = variant->Threaded ? decodeThreaded(&papa) : decodeSequential(&papa);
+		for(int m = 0; m < golden.count(); m++)
+		{
+			QString difference = compare(m < decoded.count() ? decoded[m] : QImage(), golden[m]);
+			if(!difference.isEmpty())
+			{
+				err << name << " mipmap " << m << " (" << variant->Name << "): " << difference << endl;
+				success = false;
+			}
+		}
+	}
+
+	if(papa.canEncode() && papa.format() != "DXT1")
+	{
+		// The DXT1 encoder picks its own endpoints, so it can't give back the
+		// blocks it was handed.
+		QFile file(filename);
+		QByteArray original, encoded;
+		if(!file.open(QIODevice::ReadOnly))
+		{
+			err << name << ": " << file.errorString() << endl;
+			return false;
+		}
+		original = file.readAll();
+
+		QList<const PapaKernels::kernels_t *> kernels = PapaKernels::available();
+		for(int i = 0; i < kernels.count(); i++)
+		{
+			PapaKernels::select(kernels[i]->Name);
+			if(!papa.encode(encoded))
+			{
+				err << name << " encoding (" << kernels[i]->Name << "): " << papa.lastError() << endl;
+				success = false;
+			}
+			else if(encoded != original)
+			{
+				int j = 0;
+				while(j < encoded.length() && j < original.length() && encoded[j] == original[j])
+					j++;
+				err << name << " encoding (" << kernels[i]->Name << "): differs from the original at byte " << j << endl;
+				success = false;
+			}
+		}
+	}
+
+	out << (success ? "ok   " : "FAIL ") << name << endl;
+	return success;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QStringList args = app.arguments();
+	if(args.count() != 2)
+	{
+		err << "Usage: papa_conformance <directory>" << endl;
+		return 2;
+	}
+
+	QStringList files = QDir(args[1]).entryList(QStringList() << "*.papa", QDir::Files, QDir::Name);
+	if(files.isEmpty())
+	{
+		err << "No papa files in " << args[1] << endl;
+		return 2;
+	}
+
+	int failed = 0;
+	foreach(QString file, files)
+	{
+		if(!checkFile(args[1], QFileInfo(file).completeBaseName()))
+			failed++;
+	}
+
+	QStringList names;
+	QList<const PapaKernels::kernels_t *> kernels = PapaKernels::available();
+	for(int i = 0; i < kernels.count(); i++)
+		names.append(kernels[i]->Name);
+	out << files.count() - failed << " of " << files.count() << " passed with the " << names.join(", ") << " kernels" << endl;
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+# Writes the papa files of the conformance test and their golden images.
+#
+# The decoders in here follow the scalar C++ ones to the bit, rounding and
+# all, so the goldens don't depend on the code they check. Run it again
+# only when the expected output changes on purpose, and say why in the
+# commit.
+
+import os
+import random
+import struct
+import zlib
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+A8R8G8B8, X8R8G8B8, DXT1, DXT5 = 1, 2, 4, 6
+
+
+def mip_size(width, height, mip):
+    return max(1, width >> mip), max(1, height >> mip)
+
+
+def mip_chain(width, height):
+    mips = 1
+    while max(width, height) >> mips > 0:
+        mips += 1
+    return mips
+
+
+def blocks(width, height):
+    return ((width + 3) // 4) * ((height + 3) // 4)
+
+
+def write_papa(filename, fmt, width, height, srgb, data, bone):
+    mips = len(data)
+    payload = b''.join(data)
+    header_size, texture_header_size = 104, 24
+    bones_offset = header_size + texture_header_size + len(payload)
+    name_offset = bones_offset + 16
+
+    out = b'apaP'
+    out += struct.pack('<hh', 0, 0)
+    out += struct.pack('<hh', 1, 1)
+    out += struct.pack('<6h', 0, 0, 0, 0, 0, 0)
+    out += struct.pack('<4h', 0, 0, 0, 0)
+    out += struct.pack('<qq', bones_offset, header_size)
+    out += struct.pack('<7q', -1, -1, -1, -1, -1, -1, -1)
+    out += struct.pack('<BBBBhhqq', 0, 0, fmt, (mips & 0x0f) | (0x80 if srgb else 0), width, height, len(payload), 128)
+    out += payload
+    out += struct.pack('<qq', len(bone), name_offset)
+    out += bone.encode('ascii')
+    with open(filename, 'wb') as f:
+        f.write(out)
+
+
+def write_png(filename, width, height, pixels):
+    # pixels is a list of (r, g, b, a) rows
+    raw = b''.join(b'\x00' + bytes(c for pixel in row for c in pixel) for row in pixels)
+
+    def chunk(kind, body):
+        return struct.pack('>I', len(body)) + kind + body + struct.pack('>I', zlib.crc32(kind + body) & 0xffffffff)
+
+    png = b'\x89PNG\r\n\x1a\n'
+    png += chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 6, 0, 0, 0))
+    png += chunk(b'IDAT', zlib.compress(raw, 9))
+    png += chunk(b'IEND', b'')
+    with open(filename, 'wb') as f:
+        f.write(png)
+
+
+def expand(r, g, b):
+    return 255 * r // 32, 255 * g // 64, 255 * b // 32
+
+
+def split(colour):
+    return colour >> 11, (colour >> 5) & 63, colour & 31
+
+
+def colour_palette(c0, c1, three_colour_mode):
+    r0, g0, b0 = split(c0)
+    r1, g1, b1 = split(c1)
+    if not three_colour_mode or c0 > c1:
+        c2 = ((2 * r0 + r1) // 3, (2 * g0 + g1) // 3, (2 * b0 + b1) // 3)
+        c3 = ((r0 + 2 * r1) // 3, (g0 + 2 * g1) // 3, (b0 + 2 * b1) // 3)
+        return [expand(r0, g0, b0), expand(r1, g1, b1), expand(*c2), expand(*c3)]
+    c2 = ((r0 + r1) // 2, (g0 + g1) // 2, (b0 + b1) // 2)
+    return [expand(r0, g0, b0), expand(r1, g1, b1), expand(*c2), (0, 0, 0)]
+
+
+def alpha_palette(a0, a1):
+    palette = [a0, a1]
+    if a0 > a1:
+        palette += [int(((6. - k) * a0 + (k + 1.) * a1) / 7.) for k in range(6)]
+    else:
+        palette += [int(((4. - k) * a0 + (k + 1.) * a1) / 5.) for k in range(4)] + [0, 255]
+    return palette
+
+
+def decode_blocks(fmt, width, height, data):
+    pixels = [[None] * width for _ in range(height)]
+    size = 8 if fmt == DXT1 else 16
+    wide = (width + 3) // 4
+    for j in range(blocks(width, height)):
+        block = data[j * size:(j + 1) * size]
+        alphas = [255] * 16
+        if fmt == DXT5:
+            a0, a1 = block[0], block[1]
+            bits = int.from_bytes(block[2:8], 'little')
+            palette = alpha_palette(a0, a1)
+            for i in range(16):
+                alphas[i] = palette[bits & 7]
+                bits >>= 3
+            block = block[8:]
+        c0, c1, bits = struct.unpack('<HHI', block)
+        colours = colour_palette(c0, c1, fmt == DXT1)
+        x0, y0 = j % wide, j // wide
+        for y in range(4):
+            for x in range(4):
+                index = bits & 3
+                bits >>= 2
+                if 4 * x0 + x < width and 4 * y0 + y < height:
+                    pixels[4 * y0 + y][4 * x0 + x] = colours[index] + (alphas[4 * y + x],)
+    return pixels
+
+
+def decode_pixels(fmt, width, height, data):
+    pixels = []
+    for y in range(height):
+        row = []
+        for x in range(width):
+            r, g, b, a = data[4 * (y * width + x):4 * (y * width + x) + 4]
+            row.append((r, g, b, a if fmt == A8R8G8B8 else 255))
+        pixels.append(row)
+    return pixels
+
+
+def block_data(fmt, count, rng, special):
+    # The special blocks first, then random ones.
+    data = b''.join(special)
+    size = 8 if fmt == DXT1 else 16
+    while len(data) < count * size:
+        data += bytes(rng.randrange(256) for _ in range(size))
+    return data[:count * size]
+
+
+def dxt1(c0, c1, bits):
+    return struct.pack('<HHI', c0, c1, bits)
+
+
+def dxt5(a0, a1, alphabits, c0, c1, bits):
+    return struct.pack('<BB', a0, a1) + alphabits.to_bytes(6, 'little') + struct.pack('<HHI', c0, c1, bits)
+
+
+# Four colour, three colour with black, equal endpoints, extremes.
+DXT1_SPECIAL = [
+    dxt1(0xf800, 0x001f, 0xe4e4e4e4),
+    dxt1(0x001f, 0xf800, 0x1b1b1b1b),
+    dxt1(0x07e0, 0x07e0, 0xffffffff),
+    dxt1(0xffff, 0x0000, 0x0123cdef),
+    dxt1(0x0000, 0xffff, 0xfedc3210),
+    dxt1(0x8410, 0x8411, 0xaaaa5555),
+]
+
+# Eight alphas, six alphas with 0 and 255, equal alphas, every index.
+DXT5_SPECIAL = [
+    dxt5(255, 0, 0xfac688fac688, 0xf800, 0x001f, 0xe4e4e4e4),
+    dxt5(0, 255, 0xfac688fac688, 0x001f, 0xf800, 0x1b1b1b1b),
+    dxt5(128, 128, 0x000000000000, 0x07e0, 0x07e0, 0xffffffff),
+    dxt5(17, 200, 0x76543210fedc, 0xffff, 0x0000, 0x0123cdef),
+    dxt5(201, 3, 0xffffffffffff, 0x0000, 0xffff, 0xfedc3210),
+]
+
+CASES = [
+    # name, format, width, height, sRGB
+    ('dxt1_modes', DXT1, 8, 8, False),
+    ('dxt1_odd', DXT1, 10, 6, False),
+    ('dxt1_tall', DXT1, 3, 17, False),
+    ('dxt1_1x1', DXT1, 1, 1, False),
+    ('dxt1_2x2', DXT1, 2, 2, False),
+    ('dxt1_srgb', DXT1, 8, 4, True),
+    ('dxt5_modes', DXT5, 8, 8, False),
+    ('dxt5_odd', DXT5, 6, 10, False),
+    ('dxt5_1x1', DXT5, 1, 1, False),
+    ('dxt5_srgb', DXT5, 4, 8, True),
+    ('argb_odd', A8R8G8B8, 5, 3, False),
+    ('argb_1x1', A8R8G8B8, 1, 1, False),
+    ('xrgb_odd', X8R8G8B8, 7, 5, False),
+]
+
+
+def main():
+    rng = random.Random(44)
+    for name, fmt, width, height, srgb in CASES:
+        data = []
+        for mip in range(mip_chain(width, height)):
+            w, h = mip_size(width, height, mip)
+            if fmt in (DXT1, DXT5):
+                special = (DXT1_SPECIAL if fmt == DXT1 else DXT5_SPECIAL) if mip == 0 else []
+                data.append(block_data(fmt, blocks(w, h), rng, special))
+            else:
+                data.append(bytes(rng.randrange(256) for _ in range(4 * w * h)))
+
+        write_papa(os.path.join(HERE, name + '.papa'), fmt, width, height, srgb, data, name)
+        for mip, mipdata in enumerate(data):
+            w, h = mip_size(width, height, mip)
+            if fmt in (DXT1, DXT5):
+                pixels = decode_blocks(fmt, w, h, mipdata)
+            else:
+                pixels = decode_pixels(fmt, w, h, mipdata)
+            write_png(os.path.join(HERE, '%s.mip%d.png' % (name, mip)), w, h, pixels)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,335 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "conversionserver.h"
+#include "taskscheduler.h"
+#include "batchexporter.h"
+#include "batchscanner.h"
+#include "papafile.h"
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QDataStream>
+#include <QRunnable>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QtEndian>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+class ConversionJob : public QRunnable
+{
+public:
+	ConversionJob(QObject *server, QObject *socket, quint32 id, const QString& operation, const QStringList& arguments)
+	 : Server(server), Socket(socket), Id(id), Operation(operation), Arguments(arguments)
+	{
+	}
+
+	virtual void run()
+	{
+		QString result;
+		bool success = ConversionServer::execute(Operation, Arguments, result);
+		QMetaObject::invokeMethod(Server, "jobDone", Qt::QueuedConnection, Q_ARG(QObject *, Socket), Q_ARG(quint32, Id), Q_ARG(bool, success), Q_ARG(QString, result));
+	}
+
+private:
+	QObject *Server;
+	QObject *Socket;
+	quint32 Id;
+	QString Operation;
+	QStringList Arguments;
+};
+
+ConversionServer::ConversionServer(int threadcount, QObject* parent)
+ : QObject(parent)
+{
+	Scheduler = new TaskScheduler(threadcount, this);
+	Server = new QLocalServer(this);
+	connect(Server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+ConversionServer::~ConversionServer()
+{
+	// Stops the workers before the sockets they report to go away.
+	delete Scheduler;
+}
+
+bool ConversionServer::listen(const QString& name)
+{
+	// A server that crashed leaves its socket file behind, which would make
+	// the listen fail.
+	QLocalServer::removeServer(name);
+
+	// The server reads and writes any file it is asked to, so only the user
+	// running it may connect. Qt 4 has no socket options for that, the
+	// socket file is created without access for anyone else instead.
+#ifdef Q_OS_UNIX
+	mode_t mask = umask(077);
+#endif
+	bool listening = Server->listen(name);
+#ifdef Q_OS_UNIX
+	umask(mask);
+#endif
+	if(!listening)
+	{
+		Error = Server->errorString();
+		return false;
+	}
+
+	return true;
+}
+
+int ConversionServer::pathArguments(const QString& operation)
+{
+	return (operation == "inspect") ? 1 : (operation == "decode" || operation == "encode") ? 2 : 0;
+}
+
+void ConversionServer::newConnection()
+{
+	while(Server->hasPendingConnections())
+	{
+		QLocalSocket *socket = Server->nextPendingConnection();
+		Clients.insert(socket, QByteArray());
+		connect(socket, SIGNAL(readyRead()), this, SLOT(readRequests()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
+	}
+}
+
+void ConversionServer::readRequests()
+{
+	QLocalSocket *socket = static_cast<QLocalSocket *>(sender());
+	if(!Clients.contains(socket))
+		return;
+
+	QByteArray& buffer = Clients[socket];
+	buffer.append(socket->readAll());
+
+	QByteArray payload;
+	while(takeFrame(buffer, payload))
+	{
+		QDataStream stream(payload);
+		stream.setVersion(QDataStream::Qt_4_6);
+		quint32 id;
+		QString operation;
+		QStringList arguments;
+		stream >> id >> operation >> arguments;
+		if(stream.status() != QDataStream::Ok)
+		{
+			// Nothing after a broken frame can be trusted.
+			respond(socket, 0, false, "Malformed request");
+			socket->disconnectFromServer();
+			return;
+		}
+
+		if(operation == "status")
+			respond(socket, id, true, Scheduler->report());
+		else if(operation == "shutdown")
+		{
+			respond(socket, id, true, QString());
+			socket->flush();
+			QCoreApplication::quit();
+		}
+		else
+		{
+			// Header reads are quick, they don't wait behind the conversions.
+			TaskScheduler::Priority priority = (operation == "inspect") ? TaskScheduler::Selection : TaskScheduler::Edit;
+			Scheduler->start(new ConversionJob(this, socket, id, operation, arguments), priority, socket);
+			Pending[socket]++;
+		}
+	}
+}
+
+void ConversionServer::disconnected()
+{
+	// The answers to whatever is still running go nowhere, jobDone drops
+	// them once the socket is out of Clients. The socket stays around until
+	// the last of them came back, without holding up the other clients.
+	QLocalSocket *socket = static_cast<QLocalSocket *>(sender());
+	Clients.remove(socket);
+	Pending[socket] -= Scheduler->cancel(socket);
+	if(Pending[socket] == 0)
+	{
+		Pending.remove(socket);
+		socket->deleteLater();
+	}
+}
+
+void ConversionServer::jobDone(QObject* socket, quint32 id, bool success, const QString& result)
+{
+	QLocalSocket *client = static_cast<QLocalSocket *>(socket);
+	if(Clients.contains(client))
+		respond(client, id, success, result);
+
+	if(--Pending[client] == 0)
+	{
+		Pending.remove(client);
+		if(!Clients.contains(client))
+			client->deleteLater();
+	}
+}
+
+void ConversionServer::respond(QLocalSocket* socket, quint32 id, bool success, const QString& result)
+{
+	QByteArray payload;
+	QDataStream stream(&payload, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_4_6);
+	stream << id << success << result;
+	socket->write(frame(payload));
+}
+
+bool ConversionServer::execute(const QString& operation, const QStringList& arguments, QString& result)
+{
+	// Relative paths would be taken from the server's working directory,
+	// which has nothing to do with the client's.
+	if(operation == "inspect" || operation == "decode" || operation == "encode")
+	{
+		for(int i = 0; i < arguments.count() && i < pathArguments(operation); i++)
+		{
+			if(QDir::isRelativePath(arguments[i]))
+			{
+				result = QString("Not an absolute path: %1").arg(arguments[i]);
+				return false;
+			}
+		}
+	}
+
+	if(operation == "inspect" && arguments.count() == 1)
+	{
+		PapaFile::info_t info;
+		QString error;
+		PapaFile::inspect(arguments[0], info, error);
+		result = BatchScanner::jsonRecord(arguments[0], QFileInfo(arguments[0]).size(), info, error);
+		return error.isEmpty();
+	}
+	else if(operation == "decode" && (arguments.count() == 2 || arguments.count() == 4))
+	{
+		int texture = (arguments.count() == 4) ? arguments[2].toInt() : 0;
+		int mipmap = (arguments.count() == 4) ? arguments[3].toInt() : 0;
+		PapaFile papa(arguments[0]);
+		if(!papa.isValid())
+		{
+			result = papa.lastError();
+			return false;
+		}
+		if(texture < 0 || texture >= papa.textureCount() || mipmap < 0 || mipmap >= papa.mipCount(texture))
+		{
+			result = QString("There's no mipmap %1 of texture %2").arg(mipmap).arg(texture);
+			return false;
+		}
+
+		QImage image = papa.mipmap(texture, mipmap);
+		if(image.isNull())
+		{
+			result = papa.lastError();
+			return false;
+		}
+
+		// The format comes from the file name.
+		QByteArray data;
+		if(!BatchExporter::encodeImage(image, QFileInfo(arguments[1]).suffix(), data, result))
+			return false;
+
+		QDir().mkpath(QFileInfo(arguments[1]).absolutePath());
+		QFile file(arguments[1]);
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.length())
+		{
+			result = file.errorString();
+			return false;
+		}
+
+		result = arguments[1];
+		return true;
+	}
+	else if(operation == "encode" && arguments.count() == 2)
+	{
+		PapaFile papa(arguments[1]);
+		if(!papa.isValid())
+		{
+			result = papa.lastError();
+			return false;
+		}
+		if(!papa.canEncode())
+		{
+			result = QString("Can't encode %1 textures yet").arg(papa.format());
+			return false;
+		}
+
+		QImage image(arguments[0]);
+		if(image.isNull())
+		{
+			result = "Couldn't decode the image";
+			return false;
+		}
+
+		QByteArray contents;
+		if(!papa.importImage(image, 0) || !papa.encode(contents) || !papa.store(arguments[1], contents))
+		{
+			result = papa.lastError();
+			return false;
+		}
+
+		result = arguments[1];
+		return true;
+	}
+
+	result = QString("Unknown operation or wrong arguments: %1 %2").arg(operation).arg(arguments.join(" "));
+	return false;
+}
+
+QByteArray ConversionServer::frame(const QByteArray& payload)
+{
+	uchar length[4];
+	qToBigEndian<quint32>(payload.length(), length);
+	return QByteArray((const char *)length, sizeof(length)) + payload;
+}
+
+bool ConversionServer::takeFrame(QByteArray& buffer, QByteArray& payload)
+{
+	if(buffer.length() < 4)
+		return false;
+	quint32 length = qFromBigEndian<quint32>((const uchar *)buffer.constData());
+	if((quint32)buffer.length() - 4 < length)
+		return false;
+
+	payload = buffer.mid(4, length);
+	buffer.remove(0, 4 + length);
+	return true;
+}
+
+QByteArray ConversionServer::request(quint32 id, const QString& operation, const QStringList& arguments)
+{
+	QByteArray payload;
+	QDataStream stream(&payload, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_4_6);
+	stream << id << operation << arguments;
+	return frame(payload);
+}
+
+bool ConversionServer::readResponse(const QByteArray& payload, quint32& id, bool& success, QString& result)
+{
+	QDataStream stream(payload);
+	stream.setVersion(QDataStream::Qt_4_6);
+	stream >> id >> success >> result;
+	return stream.status() == QDataStream::Ok;
+}
+
+#include "conversionserver.moc"
@@ -0,0 +1,85 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONVERSIONSERVER_H
+#define CONVERSIONSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+
+class QLocalServer;
+class QLocalSocket;
+class TaskScheduler;
+
+// Keeps the codec threads running between conversions, so a build script
+// that converts one file at a time doesn't pay for starting papatool each
+// time. Clients connect to a local socket (a Unix domain socket or a named
+// pipe) and send request frames, each answered by a response frame with
+// the same id. A client may send a whole batch before reading anything,
+// the answers come back in the order the conversions finish.
+//
+// Every frame is a 32 bit big endian payload length followed by the
+// payload, which is QDataStream (Qt 4.6) encoded:
+//   request:  quint32 id, QString operation, QStringList arguments
+//   response: quint32 id, bool success, QString result
+//
+// Operations:
+//   inspect <papa>                          header as a JSON object
+//   decode <papa> <image> [texture mipmap]  saves a mipmap as an image
+//   encode <image> <papa>                   imports the image and saves
+//   status                                  the scheduler's counters
+//   shutdown                                stops the server
+//
+// The files have to be given as absolute paths. Only the user that started
+// the server can connect to it.
+class ConversionServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	ConversionServer(int threadcount = 0, QObject *parent = 0);
+	~ConversionServer();
+	bool listen(const QString& name);
+	QString errorString() {return Error;}
+
+	static bool execute(const QString& operation, const QStringList& arguments, QString& result);
+	static int pathArguments(const QString& operation); // How many of the arguments are files
+	static QByteArray frame(const QByteArray& payload);
+	static bool takeFrame(QByteArray& buffer, QByteArray& payload);
+	static QByteArray request(quint32 id, const QString& operation, const QStringList& arguments);
+	static bool readResponse(const QByteArray& payload, quint32& id, bool& success, QString& result);
+
+private slots:
+	void newConnection();
+	void readRequests();
+	void disconnected();
+	void jobDone(QObject *socket, quint32 id, bool success, const QString& result);
+
+private:
+	void respond(QLocalSocket *socket, quint32 id, bool success, const QString& result);
+
+	QLocalServer *Server;
+	TaskScheduler *Scheduler;
+	QHash<QLocalSocket *, QByteArray> Clients; // Unframed input per connection
+	QHash<QLocalSocket *, int> Pending; // Jobs that haven't reported back yet
+	QString Error;
+};
+
+#endif // CONVERSIONSERVER_H
@@ -0,0 +1,303 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Times what the editor does with a whole directory: loading the list,
+// going through the textures one by one and saving some of them, first
+// with the files out of the page cache and then again with them in it.
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QTimer>
+#include <QVector>
+#include "texturelistmodel.h"
+#include "papagenerator.h"
+#include "perfbaseline.h"
+#include <algorithm>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+// Gets the files out of the page cache, so the next pass has to go to the
+// disk. Only Linux lets us do that without being root.
+static bool evict(const QStringList& filenames)
+{
+#if defined(Q_OS_LINUX)
+	for(QStringList::const_iterator filename = filenames.constBegin(); filename != filenames.constEnd(); ++filename)
+	{
+		int fd = open(QFile::encodeName(*filename).constData(), O_RDONLY);
+		if(fd < 0)
+			continue;
+		fdatasync(fd); // Dirty pages can't be dropped
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+	return true;
+#else
+	Q_UNUSED(filenames);
+	return false;
+#endif
+}
+
+static bool waitFor(QObject *object, const char *signal, int timeout)
+{
+	QEventLoop loop;
+	QTimer timer;
+	timer.setSingleShot(true);
+	QObject::connect(object, signal, &loop, SLOT(quit()));
+	QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+	timer.start(timeout);
+	loop.exec();
+	return timer.isActive();
+}
+
+struct timing_t
+{
+	QString Name;
+	int Count;
+	double Total; // Milliseconds
+	double Mean;
+	double P95;
+	double Maximum;
+};
+
+static timing_t summarise(const QString& name, QVector<double> times)
+{
+	timing_t timing;
+	timing.Name = name;
+	timing.Count = times.count();
+	timing.Total = timing.Mean = timing.P95 = timing.Maximum = 0;
+	if(times.isEmpty())
+		return timing;
+
+	qSort(times);
+	for(int i = 0; i < times.count(); i++)
+		timing.Total += times[i];
+	timing.Mean = timing.Total / times.count();
+	timing.P95 = times[std::min(times.count() - 1, (int)(0.95 * times.count()))];
+	timing.Maximum = times.last();
+	return timing;
+}
+
+static double milliseconds(const QElapsedTimer& timer)
+{
+	return timer.nsecsElapsed() / 1e6;
+}
+
+static bool runPass(const QString& directory, int selections, int saves, QList<timing_t>& timings, const QString& pass)
+{
+	TextureListModel model;
+	QElapsedTimer timer;
+
+	// Until the scanner has handed over the last row.
+	timer.start();
+	if(!model.loadFromDirectory(directory) || !waitFor(&model, SIGNAL(loadFinished()), 600000))
+	{
+		err << "Loading " << directory << " failed or timed out\n";
+		return false;
+	}
+	QVector<double> load(1, milliseconds(timer));
+	timings.append(summarise(pass + " load", load));
+	out << QString("%1 rows\n").arg(model.rowCount());
+
+	// What the editor does for the selected row, up to having the full
+	// texture to show, with the neighbours prefetched behind it.
+	QVector<double> selection;
+	for(int row = 0; row < std::min(selections, model.rowCount()); row++)
+	{
+		QModelIndex index = model.index(row);
+		timer.restart();
+		PapaFile *papa = model.papa(index);
+		QImage image = papa->mipmap(0, 0);
+		model.prefetch(index);
+		selection.append(milliseconds(timer));
+		if(image.isNull())
+			err << papa->filename() << ": " << papa->lastError() << '\n';
+		QCoreApplication::processEvents();
+	}
+	timings.append(summarise(pass + " select", selection));
+
+	// Saving means encoding, so only after an import.
+	QVector<double> save;
+	for(int row = 0; row < model.rowCount() && save.count() < saves; row++)
+	{
+		QModelIndex index = model.index(row);
+		PapaFile *papa = model.papa(index);
+		if(!model.isEditable(index) || !papa->canEncode())
+			continue;
+
+		timer.restart();
+		if(!papa->importImage(PapaGenerator::image(papa->size(0).width(), papa->size(0).height(), row), 0) || !model.savePapa(index))
+		{
+			err << papa->filename() << ": " << papa->lastError() << '\n';
+			continue;
+		}
+		if(!waitFor(&model, SIGNAL(taskFinished(int, bool, const QString&)), 600000))
+		{
+			err << "Saving timed out\n";
+			return false;
+		}
+		save.append(milliseconds(timer));
+	}
+	timings.append(summarise(pass + " save", save));
+
+	return true;
+}
+
+static QString takeOption(QStringList& arguments, const QString& name, const QString& defaultvalue)
+{
+	int index = arguments.indexOf(name);
+	if(index < 0 || index + 1 >= arguments.count())
+		return defaultvalue;
+
+	QString value = arguments[index + 1];
+	arguments.removeAt(index);
+	arguments.removeAt(index);
+	return value;
+}
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	arguments.removeFirst();
+
+	int generate = takeOption(arguments, "--generate", "0").toInt();
+	QString sizes = takeOption(arguments, "--sizes", QString());
+	int selections = takeOption(arguments, "--selections", "200").toInt();
+	int saves = takeOption(arguments, "--saves", "20").toInt();
+	QString jsonfile = takeOption(arguments, "--json", QString());
+	QString label = takeOption(arguments, "--label", QString());
+	QString baselinefile = takeOption(arguments, "--baseline", QString());
+	double tolerance = takeOption(arguments, "--tolerance", "10").toDouble();
+	bool update = (arguments.removeAll("--update-baseline") > 0);
+	if(arguments.count() != 1)
+	{
+		err << "Usage: papa_corpus_bench [--generate count [--sizes 256:30,...]] [--selections rows] [--saves rows] [--json <file>]\n"
+		       "                         [--label text] [--baseline <file> [--tolerance percent] [--update-baseline]]\n"
+		       "                         <directory>\n"
+		       "Generates the corpus first if a count is given, see papatool generate for more options.\n";
+		return 2;
+	}
+	QString directory = QDir(arguments[0]).absolutePath();
+
+	if(generate > 0)
+	{
+		PapaGenerator::corpusspec_t corpus = PapaGenerator::defaultCorpus();
+		corpus.Count = generate;
+		if(!sizes.isEmpty() && !PapaGenerator::parseWeights(sizes, false, corpus.Sizes))
+		{
+			err << "Can't make sense of the sizes " << sizes << '\n';
+			return 2;
+		}
+		QStringList filenames;
+		QString error;
+		if(!PapaGenerator::writeCorpus(directory, corpus, filenames, error))
+		{
+			err << error << '\n';
+			return 1;
+		}
+	}
+
+	QStringList filenames;
+	QDirIterator entry(directory, QStringList("*.papa"), QDir::Files, QDirIterator::Subdirectories);
+	while(entry.hasNext())
+		filenames.append(entry.next());
+
+	QList<timing_t> timings;
+	bool success = true;
+	if(evict(filenames))
+		success &= runPass(directory, selections, saves, timings, "cold");
+	else
+		err << "Can't drop files from the cache here, skipping the cold pass\n";
+	success &= runPass(directory, selections, saves, timings, "warm");
+
+	for(int i = 0; i < timings.count(); i++)
+	{
+		const timing_t& timing = timings[i];
+		out << QString("%1 %2 times, total %3 ms, mean %4 ms, p95 %5 ms, max %6 ms")
+			.arg(timing.Name, -12)
+			.arg(timing.Count, 4)
+			.arg(timing.Total, 9, 'f', 1)
+			.arg(timing.Mean, 8, 'f', 2)
+			.arg(timing.P95, 8, 'f', 2)
+			.arg(timing.Maximum, 8, 'f', 2) << '\n';
+	}
+	out.flush();
+
+	if(!jsonfile.isEmpty())
+	{
+		QFile file(jsonfile);
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		{
+			err << jsonfile << ": " << file.errorString() << '\n';
+			return 1;
+		}
+
+		QString escaped = label;
+		escaped.replace('\\', "\\\\").replace('"', "\\\"");
+		QTextStream stream(&file);
+		stream << "{\"label\":\"" << escaped << "\",\"files\":" << filenames.count() << ",\"results\":[\n";
+		for(int i = 0; i < timings.count(); i++)
+		{
+			const timing_t& timing = timings[i];
+			stream << QString("{\"name\":\"%1\",\"count\":%2,\"total_ms\":%3,\"mean_ms\":%4,\"p95_ms\":%5,\"max_ms\":%6}")
+				.arg(timing.Name)
+				.arg(timing.Count)
+				.arg(timing.Total, 0, 'f', 3)
+				.arg(timing.Mean, 0, 'f', 3)
+				.arg(timing.P95, 0, 'f', 3)
+				.arg(timing.Maximum, 0, 'f', 3)
+				<< (i + 1 < timings.count() ? ",\n" : "\n");
+		}
+		stream << "]}\n";
+	}
+
+	// Loading is one number, the rest are judged by their means.
+	if(!baselinefile.isEmpty())
+	{
+		PerfBaseline measured;
+		for(int i = 0; i < timings.count(); i++)
+		{
+			if(timings[i].Count > 0)
+				measured.add(QString(timings[i].Name).replace(' ', '_') + "_mean_ms", timings[i].Mean, false);
+		}
+		if(PerfBaseline::peakResidentKb() >= 0)
+			measured.add("peak_resident_kb", PerfBaseline::peakResidentKb(), false);
+
+		QStringList report;
+		success &= measured.check(baselinefile, tolerance, update, report);
+		for(QStringList::const_iterator line = report.constBegin(); line != report.constEnd(); ++line)
+			out << *line << '\n';
+		out.flush();
+	}
+
+	err.flush();
+	return success ? 0 : 1;
+}
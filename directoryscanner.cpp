@@ -0,0 +1,156 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "directoryscanner.h"
+#include "papafile.h"
+#include "taskscheduler.h"
+#include <QDirIterator>
+#include <QMutexLocker>
+#include <QRunnable>
+
+class ScanJob : public QRunnable
+{
+public:
+	ScanJob(DirectoryScanner *scanner)
+	 : Scanner(scanner)
+	{
+	}
+
+	virtual void run()
+	{
+		Scanner->scan();
+	}
+
+private:
+	DirectoryScanner *Scanner;
+};
+
+DirectoryScanner::DirectoryScanner(TaskScheduler *scheduler, const QString& foldername, QObject* parent)
+ : QObject(parent), Scheduler(scheduler), Folder(foldername), Cancelled(0), Running(0), Entry(NULL), FirstBatch(true)
+{
+}
+
+DirectoryScanner::~DirectoryScanner()
+{
+	cancel();
+	Scheduler->cancel(this);
+	Scheduler->waitForDone(this);
+	delete Entry;
+
+	for(QList<PapaFile *>::iterator papa = Papas.begin(); papa != Papas.end(); ++papa)
+		delete (*papa);
+	for(QList<PapaFile *>::iterator papa = PendingPapas.begin(); papa != PendingPapas.end(); ++papa)
+		delete (*papa);
+}
+
+void DirectoryScanner::start()
+{
+	Running = 1;
+	Directories.push_back(Folder);
+	Timer.start();
+	Entry = new QDirIterator(Folder, QStringList("*.papa"), QDir::AllDirs | QDir::NoDotAndDotDot | QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+	Scheduler->start(new ScanJob(this), TaskScheduler::Indexing, this);
+}
+
+void DirectoryScanner::cancel()
+{
+	// Under the lock, so a slice that still requeues itself does so before
+	// the destructor cancels the scheduler's jobs.
+	QMutexLocker locker(&Mutex);
+	Cancelled = 1;
+}
+
+void DirectoryScanner::scan()
+{
+	// Scans a slice of the tree at a time and then queues itself again, so
+	// anything more important gets the worker in between.
+	int entries = 0;
+	while(entries++ < 256 && Entry->hasNext() && !Cancelled)
+	{
+		QString filename = Entry->next();
+		if(Entry->fileInfo().isDir())
+		{
+			Directories.push_back(filename);
+			continue;
+		}
+
+		Scanned.push_back(filename);
+		PapaFile *papa = new PapaFile(filename);
+		if(papa->isValid() && papa->textureCount() == 1)
+		{
+			// The model lives in the same thread as we do.
+			papa->moveToThread(thread());
+			Papas.push_back(papa);
+		}
+		else
+			delete papa;
+
+		// Hand over the first texture right away so the list fills up
+		// immediately, after that in batches to keep the view responsive.
+		if(!Papas.isEmpty() && (FirstBatch || Papas.count() >= 512 || Timer.elapsed() >= 50))
+		{
+			flush(Papas, Scanned, Directories);
+			FirstBatch = false;
+			Timer.restart();
+		}
+	}
+
+	if(Entry->hasNext())
+	{
+		QMutexLocker locker(&Mutex);
+		if(!Cancelled)
+			Scheduler->start(new ScanJob(this), TaskScheduler::Indexing, this);
+	}
+	else if(!Cancelled)
+	{
+		flush(Papas, Scanned, Directories);
+		Running = 0;
+		emit finished();
+	}
+}
+
+void DirectoryScanner::flush(QList<PapaFile *>& papas, QStringList& scanned, QStringList& directories)
+{
+	QMutexLocker locker(&Mutex);
+
+	// Only signal when the model has picked up everything from before.
+	bool wasempty = PendingPapas.isEmpty() && PendingScanned.isEmpty() && PendingDirectories.isEmpty();
+	PendingPapas += papas;
+	PendingScanned += scanned;
+	PendingDirectories += directories;
+	papas.clear();
+	scanned.clear();
+	directories.clear();
+
+	if(wasempty)
+		emit batchReady();
+}
+
+void DirectoryScanner::takeBatch(QList<PapaFile *>& papas, QStringList& scanned, QStringList& directories)
+{
+	QMutexLocker locker(&Mutex);
+	papas = PendingPapas;
+	scanned = PendingScanned;
+	directories = PendingDirectories;
+	PendingPapas.clear();
+	PendingScanned.clear();
+	PendingDirectories.clear();
+}
+
+#include "directoryscanner.moc"
@@ -0,0 +1,72 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QStringList>
+#include <QElapsedTimer>
+
+class PapaFile;
+class TaskScheduler;
+class QDirIterator;
+
+class DirectoryScanner : public QObject
+{
+	Q_OBJECT
+
+public:
+	DirectoryScanner(TaskScheduler *scheduler, const QString& foldername, QObject *parent = 0);
+	~DirectoryScanner();
+	void start();
+	void cancel();
+	bool isRunning() {return Running != 0;}
+	void takeBatch(QList<PapaFile *>& papas, QStringList& scanned, QStringList& directories);
+	void scan();
+
+signals:
+	void batchReady();
+	void finished();
+
+private:
+	void flush(QList<PapaFile *>& papas, QStringList& scanned, QStringList& directories);
+
+	TaskScheduler *Scheduler;
+	QString Folder;
+	QAtomicInt Cancelled;
+	QAtomicInt Running;
+
+	// Only touched by the one scan job that is running
+	QDirIterator *Entry;
+	QList<PapaFile *> Papas;
+	QStringList Scanned;
+	QStringList Directories;
+	bool FirstBatch;
+	QElapsedTimer Timer;
+
+	QMutex Mutex;
+	QList<PapaFile *> PendingPapas;
+	QStringList PendingScanned;
+	QStringList PendingDirectories;
+};
+
+#endif // DIRECTORYSCANNER_H
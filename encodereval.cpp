@@ -0,0 +1,448 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Runs the DXT1 encoder with every combination of the options asked for
+// over a set of images, and measures how fast it went and how close the
+// decoded result is to the original. Prints a summary per configuration,
+// and with --csv one line per image and configuration for plotting.
+
+#include <stdlib.h>
+#include <math.h>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRegExp>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+#include "papafile.h"
+#include "papagenerator.h"
+#include <algorithm>
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+struct source_t
+{
+	QString Name;
+	QImage Image;
+};
+
+struct evaluation_t
+{
+	QString Source;
+	int Width;
+	int Height;
+	PapaFile::encoderoptions_t Options;
+	double Seconds; // Per encode
+	double RMSE;
+	double PSNR;
+	double SSIM;
+};
+
+struct quality_t
+{
+	double RMSE;
+	double PSNR;
+	double SSIM;
+};
+
+// The channels as planes of floats, so the metrics are simple loops over
+// contiguous memory that the compiler can vectorise.
+static void planes(const QImage& image, QVector<float>& red, QVector<float>& green, QVector<float>& blue, QVector<float>& luma)
+{
+	QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+	int count = rgb.width() * rgb.height();
+	red.resize(count);
+	green.resize(count);
+	blue.resize(count);
+	luma.resize(count);
+	for(int y = 0; y < rgb.height(); y++)
+	{
+		const QRgb *line = (const QRgb *)rgb.constScanLine(y);
+		int offset = y * rgb.width();
+		for(int x = 0; x < rgb.width(); x++)
+		{
+			red[offset + x] = qRed(line[x]);
+			green[offset + x] = qGreen(line[x]);
+			blue[offset + x] = qBlue(line[x]);
+		}
+	}
+	for(int i = 0; i < count; i++)
+		luma[i] = 0.299f * red[i] + 0.587f * green[i] + 0.114f * blue[i];
+}
+
+static double squaredError(const QVector<float>& a, const QVector<float>& b)
+{
+	const float *pa = a.constData();
+	const float *pb = b.constData();
+	double sum = 0;
+	for(int i = 0; i < a.count(); i++)
+	{
+		float difference = pa[i] - pb[i];
+		sum += difference * difference;
+	}
+	return sum;
+}
+
+// Mean SSIM of the luma over 8x8 windows, 4 pixels apart. Images smaller
+// than a window are one window.
+static double ssim(const QVector<float>& a, const QVector<float>& b, int width, int height)
+{
+	const double c1 = (0.01 * 255) * (0.01 * 255);
+	const double c2 = (0.03 * 255) * (0.03 * 255);
+	int windowwidth = std::min(8, width);
+	int windowheight = std::min(8, height);
+
+	double total = 0;
+	int windows = 0;
+	for(int y0 = 0; y0 + windowheight <= height; y0 += 4)
+	{
+		for(int x0 = 0; x0 + windowwidth <= width; x0 += 4)
+		{
+			float suma = 0, sumb = 0, sumaa = 0, sumbb = 0, sumab = 0;
+			for(int y = y0; y < y0 + windowheight; y++)
+			{
+				const float *pa = a.constData() + y * width + x0;
+				const float *pb = b.constData() + y * width + x0;
+				for(int x = 0; x < windowwidth; x++)
+				{
+					suma += pa[x];
+					sumb += pb[x];
+					sumaa += pa[x] * pa[x];
+					sumbb += pb[x] * pb[x];
+					sumab += pa[x] * pb[x];
+				}
+			}
+
+			double n = windowwidth * windowheight;
+			double meana = suma / n;
+			double meanb = sumb / n;
+			double variancea = sumaa / n - meana * meana;
+			double varianceb = sumbb / n - meanb * meanb;
+			double covariance = sumab / n - meana * meanb;
+			total += ((2 * meana * meanb + c1) * (2 * covariance + c2)) / ((meana * meana + meanb * meanb + c1) * (variancea + varianceb + c2));
+			windows++;
+		}
+	}
+	return windows > 0 ? total / windows : 1;
+}
+
+static quality_t compare(const QImage& original, const QImage& decoded)
+{
+	QVector<float> r0, g0, b0, y0, r1, g1, b1, y1;
+	planes(original, r0, g0, b0, y0);
+	planes(decoded, r1, g1, b1, y1);
+
+	quality_t quality;
+	double samples = 3.0 * std::max(r0.count(), 1);
+	quality.RMSE = sqrt((squaredError(r0, r1) + squaredError(g0, g1) + squaredError(b0, b1)) / samples);
+	quality.PSNR = quality.RMSE > 0 ? std::min(20 * log10(255 / quality.RMSE), 100.0) : 100; // Identical images are capped
+	quality.SSIM = ssim(y0, y1, original.width(), original.height());
+	return quality;
+}
+
+// Encodes the image as DXT1 with the options, as often as fits in the
+// time, and decodes the result again.
+static bool evaluate(const source_t& source, const QString& templatefile, const QString& encodedfile, const PapaFile::encoderoptions_t& options, double mintime, evaluation_t& evaluation)
+{
+	PapaFile papa(templatefile);
+	papa.setEncoderOptions(options);
+	if(!papa.isValid() || !papa.importImage(source.Image, 0))
+	{
+		err << source.Name << ": " << papa.lastError() << '\n';
+		return false;
+	}
+
+	// The endpoint search uses rand(), so every configuration gets the
+	// same sequence.
+	QByteArray contents;
+	QElapsedTimer timer;
+	int calls = 0;
+	timer.start();
+	do
+	{
+		srand(1);
+		if(!papa.encode(contents))
+		{
+			err << source.Name << ": " << papa.lastError() << '\n';
+			return false;
+		}
+		calls++;
+	}
+	while(timer.nsecsElapsed() < mintime * 1e9);
+	double seconds = timer.nsecsElapsed() / 1e9 / calls;
+
+	if(!papa.store(encodedfile, contents))
+	{
+		err << encodedfile << ": " << papa.lastError() << '\n';
+		return false;
+	}
+	PapaFile result(encodedfile);
+	QImage decoded = result.mipmap(0, 0);
+	if(decoded.isNull())
+	{
+		err << source.Name << ": " << result.lastError() << '\n';
+		return false;
+	}
+
+	quality_t quality = compare(source.Image, decoded);
+	evaluation.Source = source.Name;
+	evaluation.Width = source.Image.width();
+	evaluation.Height = source.Image.height();
+	evaluation.Options = options;
+	evaluation.Seconds = seconds;
+	evaluation.RMSE = quality.RMSE;
+	evaluation.PSNR = quality.PSNR;
+	evaluation.SSIM = quality.SSIM;
+	return true;
+}
+
+static QString configuration(const PapaFile::encoderoptions_t& options)
+{
+	return QString("%1 dither, %2 iterations").arg(options.Dither ? "with" : "without").arg(options.Iterations);
+}
+
+static double megapixelsPerSecond(const evaluation_t& evaluation)
+{
+	return evaluation.Width * evaluation.Height / evaluation.Seconds / 1e6;
+}
+
+static QString csv(const QString& text)
+{
+	if(!text.contains(',') && !text.contains('"'))
+		return text;
+	QString escaped = text;
+	escaped.replace('"', "\"\"");
+	return '"' + escaped + '"';
+}
+
+// Mipmap 0 of the first texture of papa files, anything else Qt can read
+// as it is.
+static bool readSources(const QString& path, int limit, QList<source_t>& sources)
+{
+	QStringList filenames;
+	if(QFileInfo(path).isDir())
+	{
+		QDirIterator entry(path, QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+		while(entry.hasNext())
+			filenames.append(entry.next());
+		filenames.sort();
+	}
+	else
+		filenames.append(path);
+
+	int added = 0;
+	for(int i = 0; i < filenames.count() && added < limit; i++)
+	{
+		source_t source;
+		source.Name = QFileInfo(path).isDir() ? QDir(path).relativeFilePath(filenames[i]) : filenames[i];
+		if(filenames[i].endsWith(".papa", Qt::CaseInsensitive))
+		{
+			PapaFile papa(filenames[i]);
+			source.Image = papa.mipmap(0, 0);
+		}
+		else if(!QImageReader::imageFormat(filenames[i]).isEmpty())
+			source.Image.load(filenames[i]);
+		else
+			continue;
+
+		if(source.Image.isNull())
+		{
+			err << filenames[i] << ": can't be read\n";
+			return false;
+		}
+		source.Image = source.Image.convertToFormat(QImage::Format_RGB32); // DXT1 has no alpha
+		sources.append(source);
+		added++;
+	}
+	return true;
+}
+
+static QString takeOption(QStringList& arguments, const QString& name, const QString& defaultvalue)
+{
+	int index = arguments.indexOf(name);
+	if(index < 0 || index + 1 >= arguments.count())
+		return defaultvalue;
+
+	QString value = arguments[index + 1];
+	arguments.removeAt(index);
+	arguments.removeAt(index);
+	return value;
+}
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	arguments.removeFirst();
+
+	QStringList dithers = takeOption(arguments, "--dither", "on,off").split(',');
+	QStringList iterations = takeOption(arguments, "--iterations", "0,100,1000").split(',');
+	int generate = takeOption(arguments, "--generate", "0").toInt();
+	QStringList sizes = takeOption(arguments, "--sizes", "256,1000x600").split(',');
+	int limit = takeOption(arguments, "--limit", "20").toInt();
+	double mintime = takeOption(arguments, "--time", "0").toDouble();
+	QString csvfile = takeOption(arguments, "--csv", QString());
+	if((arguments.isEmpty() && generate <= 0) || !arguments.filter(QRegExp("^--")).isEmpty())
+	{
+		err << "Usage: papa_encoder_eval [--dither on,off] [--iterations 0,100,...] [--time seconds] [--csv <file>]\n"
+		       "                         [--generate count [--sizes 256,WxH,...]] [--limit files] [<file or directory>...]\n";
+		return 2;
+	}
+
+	QList<PapaFile::encoderoptions_t> configurations;
+	for(QStringList::const_iterator dither = dithers.constBegin(); dither != dithers.constEnd(); ++dither)
+	{
+		for(QStringList::const_iterator iteration = iterations.constBegin(); iteration != iterations.constEnd(); ++iteration)
+		{
+			PapaFile::encoderoptions_t options = PapaFile::defaultEncoderOptions();
+			options.Dither = (*dither == "on");
+			options.Iterations = iteration->toInt();
+			configurations.append(options);
+		}
+	}
+
+	QList<source_t> sources;
+	for(int i = 0; i < generate; i++)
+	{
+		QStringList dimensions = sizes[i % sizes.count()].split('x');
+		int width = dimensions[0].toInt();
+		int height = dimensions.count() > 1 ? dimensions[1].toInt() : width;
+		source_t source;
+		source.Name = QString("generated_%1_%2x%3").arg(i).arg(width).arg(height);
+		source.Image = PapaGenerator::image(width, height, i + 1).convertToFormat(QImage::Format_RGB32);
+		sources.append(source);
+	}
+	for(QStringList::const_iterator path = arguments.constBegin(); path != arguments.constEnd(); ++path)
+	{
+		if(!readSources(*path, limit, sources))
+			return 1;
+	}
+
+	QDir temporary(QDir::temp().absoluteFilePath(QString("papa_encoder_eval-%1").arg(QCoreApplication::applicationPid())));
+	QDir().mkpath(temporary.absolutePath());
+	QString templatefile = temporary.absoluteFilePath("template.papa");
+	QString encodedfile = temporary.absoluteFilePath("encoded.papa");
+
+	QList<evaluation_t> evaluations;
+	bool success = true;
+	for(QList<source_t>::const_iterator source = sources.constBegin(); source != sources.constEnd(); ++source)
+	{
+		// A DXT1 texture of the right size for importing into, one mipmap
+		// is all the metrics look at.
+		PapaGenerator::texturespec_t texture;
+		texture.Format = 4; // DXT1
+		texture.Width = source->Image.width();
+		texture.Height = source->Image.height();
+		texture.Mipmaps = 1;
+		texture.SRGB = false;
+		QString error;
+		if(!PapaGenerator::write(templatefile, QList<PapaGenerator::texturespec_t>() << texture, QStringList("eval"), 1, error))
+		{
+			err << templatefile << ": " << error << '\n';
+			success = false;
+			break;
+		}
+
+		for(QList<PapaFile::encoderoptions_t>::const_iterator options = configurations.constBegin(); options != configurations.constEnd(); ++options)
+		{
+			evaluation_t evaluation;
+			if(!evaluate(*source, templatefile, encodedfile, *options, mintime, evaluation))
+			{
+				success = false;
+				continue;
+			}
+			evaluations.append(evaluation);
+			out << QString("%1 %2 %3 Mpixels/s RMSE %4 PSNR %5 dB SSIM %6\n")
+				.arg(evaluation.Source, -32)
+				.arg(configuration(evaluation.Options), -32)
+				.arg(megapixelsPerSecond(evaluation), 7, 'f', 2)
+				.arg(evaluation.RMSE, 6, 'f', 3)
+				.arg(evaluation.PSNR, 6, 'f', 2)
+				.arg(evaluation.SSIM, 6, 'f', 4);
+			out.flush();
+		}
+	}
+	QFile::remove(templatefile);
+	QFile::remove(encodedfile);
+	QDir().rmdir(temporary.absolutePath());
+
+	if(!csvfile.isEmpty())
+	{
+		QFile file(csvfile);
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		{
+			err << csvfile << ": " << file.errorString() << '\n';
+			return 1;
+		}
+
+		QTextStream stream(&file);
+		stream << "texture,width,height,dither,iterations,seconds,mpixels_per_s,rmse,psnr,ssim\n";
+		for(QList<evaluation_t>::const_iterator evaluation = evaluations.constBegin(); evaluation != evaluations.constEnd(); ++evaluation)
+		{
+			stream << csv(evaluation->Source) << ',' << evaluation->Width << ',' << evaluation->Height << ','
+				<< (evaluation->Options.Dither ? "on" : "off") << ',' << evaluation->Options.Iterations << ','
+				<< QString::number(evaluation->Seconds, 'g', 6) << ','
+				<< QString::number(megapixelsPerSecond(*evaluation), 'f', 3) << ','
+				<< QString::number(evaluation->RMSE, 'f', 4) << ','
+				<< QString::number(evaluation->PSNR, 'f', 3) << ','
+				<< QString::number(evaluation->SSIM, 'f', 5) << '\n';
+		}
+	}
+
+	// Averages over the images per configuration, and the worst image since
+	// one bad texture is what people notice.
+	out << '\n' << QString("%1 %2 %3 %4 %5 %6\n").arg("Configuration", -32).arg("Mpixels/s", 9).arg("RMSE", 8).arg("PSNR", 8).arg("SSIM", 8).arg("min SSIM", 8);
+	for(QList<PapaFile::encoderoptions_t>::const_iterator options = configurations.constBegin(); options != configurations.constEnd(); ++options)
+	{
+		int count = 0;
+		double seconds = 0, pixels = 0, rmse = 0, psnr = 0, totalssim = 0, minssim = 1;
+		for(QList<evaluation_t>::const_iterator evaluation = evaluations.constBegin(); evaluation != evaluations.constEnd(); ++evaluation)
+		{
+			if(evaluation->Options.Dither != options->Dither || evaluation->Options.Iterations != options->Iterations)
+				continue;
+			count++;
+			seconds += evaluation->Seconds;
+			pixels += (double)evaluation->Width * evaluation->Height;
+			rmse += evaluation->RMSE;
+			psnr += evaluation->PSNR;
+			totalssim += evaluation->SSIM;
+			minssim = std::min(minssim, evaluation->SSIM);
+		}
+		if(count == 0)
+			continue;
+
+		out << QString("%1 %2 %3 %4 %5 %6\n")
+			.arg(configuration(*options), -32)
+			.arg(pixels / seconds / 1e6, 9, 'f', 2)
+			.arg(rmse / count, 8, 'f', 3)
+			.arg(psnr / count, 8, 'f', 2)
+			.arg(totalssim / count, 8, 'f', 4)
+			.arg(minssim, 8, 'f', 4);
+	}
+
+	out.flush();
+	err.flush();
+	return success ? 0 : 1;
+}
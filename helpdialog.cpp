@@ -57,7 +57,10 @@ QString HelpDialog::getHelp()
 		"<html>"
 		"<body>"
 		"<h1>Usage</h1>"
-		"<p>Use \"File\" -&gt; \"Open directory...\" to navigate to the directory containing the papa files. It will open all of the textures in the directory and display them in the list on the left. Clicking on them will show the texture on the left. Note that the editor ignores the papa files which only contain models. Use <a href=\"https://forums.uberent.com/threads/rel-blender-importer-exporter-for-papa-files-v0-5.47964/\">raevn's Blender plugin</a> for those.</p>"
+		"<p>Use \"File\" -&gt; \"Open directory...\" to navigate to the directory containing the papa files. It will open all of the textures in the directory and its subdirectories and display them in the list on the left as they are found. Clicking on them will show the texture on the left. Note that the editor ignores the papa files which only contain models. Use <a href=\"https://forums.uberent.com/threads/rel-blender-importer-exporter-for-papa-files-v0-5.47964/\">raevn's Blender plugin</a> for those.</p>"
+		"<p>Check \"File\" -&gt; \"Watch directory\" to have the list follow changes other programs make to the directory. New, removed and changed papa files are picked up as they happen. Textures with unsaved changes are never reloaded.</p>"
+		"<p>Use \"View\" -&gt; \"Thumbnails\" to switch between the list of names and a grid of thumbnails.</p>"
+		"<p>Use the mouse wheel or \"View\" -&gt; \"Zoom in\" and \"Zoom out\" to zoom the texture, and drag it around with the mouse. When zoomed in far enough you see the individual texels.</p>"
 		"<p>Use \"File\" -&gt; \"Import...\" to overwrite the currently selected texture with your own image. You still need to use \"File\" -&gt; \"Save\" to save it into the papa file. This menu item will only be available for textures in the A8R8G8B8 or X8R8G8B8 format for now, since encoding in DXT1 or DXT5 doesn't work yet. You can see the current encoding of the texture in the status bar at the bottom. Finally, the imported texture needs to have the same resolution as the original texture.</p>"
 		"<p>Use \"File\" -&gt; \"Export...\" to export the currently selected texture. Many formats are supported, but PNG is to be preferred.</p>"
 		"<p>Use \"File\" -&gt; \"Save...\" or \"Save as...\" to save the currently selected texture to the papa file.</p>"
@@ -1,23 +1,43 @@
 #include <QtGui/QApplication>
 #include <QDir>
+#include <QStringList>
 #include "papatextureeditor.h"
+#include "papatrace.h"
 
 
 int main(int argc, char** argv)
 {
     QApplication app(argc, argv);
 
+	QStringList arguments = app.arguments();
+	QString tracefile;
+	int trace = arguments.indexOf("--trace");
+	if(trace > 0 && trace + 1 < arguments.count())
+	{
+		tracefile = arguments[trace + 1];
+		arguments.removeAt(trace);
+		arguments.removeAt(trace);
+		PapaTrace::start();
+	}
+
     PapaTextureEditor foo;
 	foo.setWindowTitle("PAPA Texture Editor");
     foo.show();
-	if(app.arguments().count() > 1)
+	if(arguments.removeAll("--stats") > 0)
+		foo.showDiagnostics(true);
+	if(arguments.count() > 1)
 	{
-		QDir openmedir(app.arguments()[1]);
+		QDir openmedir(arguments[1]);
 		if(openmedir.exists())
 		{
 			openmedir.makeAbsolute();
 			foo.openDir(openmedir);
 		}
 	}
-    return app.exec();
+    int result = app.exec();
+
+	QString error;
+	if(!tracefile.isEmpty() && !PapaTrace::write(tracefile, error))
+		qWarning("%s: %s", qPrintable(tracefile), qPrintable(error));
+    return result;
 }
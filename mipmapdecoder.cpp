@@ -0,0 +1,84 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mipmapdecoder.h"
+#include "papafile.h"
+#include "taskscheduler.h"
+#include <QRunnable>
+
+class MipmapJob : public QRunnable
+{
+public:
+	MipmapJob(MipmapDecoder *decoder, int generation, QSharedPointer<PapaFile> papa, int firstmip)
+	 : Decoder(decoder), Generation(generation), Papa(papa), FirstMip(firstmip)
+	{
+	}
+
+	virtual void run()
+	{
+		// From small to large, so the picture keeps getting sharper. Stop as
+		// soon as something else got selected.
+		for(int m = FirstMip; m >= 0; m--)
+		{
+			if(!Decoder->isCurrent(Generation))
+				return;
+
+			QImage image = Papa->mipmap(0, m, true);
+			QMetaObject::invokeMethod(Decoder, "jobFinished", Qt::QueuedConnection, Q_ARG(int, Generation), Q_ARG(int, m), Q_ARG(QImage, image));
+		}
+	}
+
+private:
+	MipmapDecoder *Decoder;
+	int Generation;
+	QSharedPointer<PapaFile> Papa;
+	int FirstMip;
+};
+
+MipmapDecoder::MipmapDecoder(TaskScheduler *scheduler, QObject* parent)
+ : QObject(parent), Generation(0), Scheduler(scheduler)
+{
+}
+
+MipmapDecoder::~MipmapDecoder()
+{
+	cancel();
+	Scheduler->waitForDone(this);
+}
+
+void MipmapDecoder::decode(QSharedPointer<PapaFile> papa, int firstmip)
+{
+	cancel();
+	if(firstmip >= 0)
+		Scheduler->start(new MipmapJob(this, Generation, papa, firstmip), TaskScheduler::Selection, this);
+}
+
+void MipmapDecoder::cancel()
+{
+	Generation.ref();
+	Scheduler->cancel(this);
+}
+
+void MipmapDecoder::jobFinished(int generation, int mipindex, const QImage& image)
+{
+	if(isCurrent(generation) && !image.isNull())
+		emit mipmapReady(mipindex, image);
+}
+
+#include "mipmapdecoder.moc"
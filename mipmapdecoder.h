@@ -0,0 +1,53 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MIPMAPDECODER_H
+#define MIPMAPDECODER_H
+
+#include <QObject>
+#include <QImage>
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+class PapaFile;
+class TaskScheduler;
+
+class MipmapDecoder : public QObject
+{
+	Q_OBJECT
+
+public:
+	MipmapDecoder(TaskScheduler *scheduler, QObject *parent = 0);
+	~MipmapDecoder();
+	void decode(QSharedPointer<PapaFile> papa, int firstmip);
+	void cancel();
+	bool isCurrent(int generation) {return Generation == generation;}
+
+signals:
+	void mipmapReady(int mipindex, const QImage& image);
+
+private slots:
+	void jobFinished(int generation, int mipindex, const QImage& image);
+
+private:
+	QAtomicInt Generation;
+	TaskScheduler *Scheduler;
+};
+
+#endif // MIPMAPDECODER_H
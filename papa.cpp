@@ -0,0 +1,188 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "papa.h"
+#include "papafile.h"
+#include <QByteArray>
+#include <string.h>
+
+struct papa_file
+{
+	PapaFile *Papa;
+	QByteArray Error;
+	QByteArray Format;
+};
+
+static int fail(papa_file *papa, const QString& error)
+{
+	papa->Error = error.toUtf8();
+	return 0;
+}
+
+static bool validMip(papa_file *papa, int texture, int mip)
+{
+	if(texture < 0 || texture >= papa->Papa->textureCount() || mip < 0 || mip >= papa->Papa->mipCount(texture))
+	{
+		fail(papa, QString("There's no mipmap %1 of texture %2").arg(mip).arg(texture));
+		return false;
+	}
+
+	return true;
+}
+
+int papa_api_version(void)
+{
+	return PAPA_API_VERSION;
+}
+
+papa_file *papa_open(const char *filename, char *error, size_t errorsize)
+{
+	PapaFile *papafile = new PapaFile(QString::fromUtf8(filename));
+	if(!papafile->isValid())
+	{
+		if(error != NULL && errorsize > 0)
+		{
+			QByteArray message = papafile->lastError().toUtf8();
+			size_t length = qMin((size_t)message.length(), errorsize - 1);
+			memcpy(error, message.constData(), length);
+			error[length] = '\0';
+		}
+		delete papafile;
+		return NULL;
+	}
+
+	papa_file *papa = new papa_file;
+	papa->Papa = papafile;
+	return papa;
+}
+
+void papa_close(papa_file *papa)
+{
+	if(papa == NULL)
+		return;
+
+	delete papa->Papa;
+	delete papa;
+}
+
+const char *papa_error(papa_file *papa)
+{
+	return papa->Error.constData();
+}
+
+int papa_texture_count(papa_file *papa)
+{
+	return papa->Papa->textureCount();
+}
+
+int papa_mip_count(papa_file *papa, int texture)
+{
+	if(texture < 0)
+		return 0;
+	return papa->Papa->mipCount(texture);
+}
+
+int papa_size(papa_file *papa, int texture, int mip, int *width, int *height)
+{
+	if(!validMip(papa, texture, mip))
+		return 0;
+
+	QSize size = papa->Papa->size(texture, mip);
+	*width = size.width();
+	*height = size.height();
+	return 1;
+}
+
+const char *papa_format(papa_file *papa)
+{
+	// Kept in the handle so the pointer stays valid until the next call.
+	papa->Format = papa->Papa->format().toUtf8();
+	return papa->Format.constData();
+}
+
+int papa_can_encode(papa_file *papa)
+{
+	return papa->Papa->canEncode() ? 1 : 0;
+}
+
+int papa_decode(papa_file *papa, int texture, int mip, unsigned char *buffer, size_t buffersize)
+{
+	if(!validMip(papa, texture, mip))
+		return 0;
+
+	QImage image = papa->Papa->mipmap(texture, mip);
+	if(image.isNull())
+		return fail(papa, papa->Papa->lastError());
+	if(buffersize < 4 * (size_t)image.width() * image.height())
+		return fail(papa, "The buffer is too small for the mipmap.");
+
+	image = image.convertToFormat(QImage::Format_ARGB32);
+	for(int y = 0; y < image.height(); y++)
+	{
+		const QRgb *line = (const QRgb *)image.constScanLine(y);
+		unsigned char *pixel = buffer + 4 * y * image.width();
+		for(int x = 0; x < image.width(); x++, pixel += 4)
+		{
+			pixel[0] = qRed(line[x]);
+			pixel[1] = qGreen(line[x]);
+			pixel[2] = qBlue(line[x]);
+			pixel[3] = qAlpha(line[x]);
+		}
+	}
+
+	return 1;
+}
+
+int papa_encode(papa_file *papa, int texture, const unsigned char *pixels, int width, int height)
+{
+	if(!validMip(papa, texture, 0))
+		return 0;
+	if(!papa->Papa->canEncode())
+		return fail(papa, QString("Can't encode %1 textures yet").arg(papa->Papa->format()));
+
+	// Checked before pixels is touched, the caller's buffer is only as big as
+	// the size it claims.
+	QSize size = papa->Papa->size(texture, 0);
+	if(width <= 0 || height <= 0 || QSize(width, height) != size)
+		return fail(papa, QString("The image is %1x%2 but texture %3 is %4x%5.").arg(width).arg(height).arg(texture).arg(size.width()).arg(size.height()));
+	if(!pixels)
+		return fail(papa, "No pixels given.");
+
+	QImage image(width, height, QImage::Format_ARGB32);
+	for(int y = 0; y < height; y++)
+	{
+		QRgb *line = (QRgb *)image.scanLine(y);
+		const unsigned char *pixel = pixels + 4 * y * width;
+		for(int x = 0; x < width; x++, pixel += 4)
+			line[x] = qRgba(pixel[0], pixel[1], pixel[2], pixel[3]);
+	}
+
+	if(!papa->Papa->importImage(image, texture))
+		return fail(papa, papa->Papa->lastError());
+
+	return 1;
+}
+
+int papa_save(papa_file *papa, const char *filename)
+{
+	if(!papa->Papa->save(filename != NULL ? QString::fromUtf8(filename) : QString()))
+		return fail(papa, papa->Papa->lastError());
+
+	return 1;
+}
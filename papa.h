@@ -0,0 +1,88 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PAPA_H
+#define PAPA_H
+
+// C interface to the papa codec, for tools that can't or don't want to use
+// PapaFile and Qt directly. None of the Qt types show through, so the
+// library can be rebuilt against another Qt without relinking the tools.
+//
+// Functions that can fail return nonzero on success and zero on failure,
+// after which papa_error says what went wrong. A handle may be used from
+// any thread, but only by one thread at a time. Strings are UTF-8.
+//
+// Pixels are 8 bit RGBA, in that byte order, with the rows top to bottom
+// and no padding between them.
+//
+// Link the static libpapa and Qt, or define PAPA_SHARED and link the
+// shared libpapa.
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(PAPA_SHARED)
+	#if defined(PAPA_BUILD)
+		#define PAPA_API __declspec(dllexport)
+	#else
+		#define PAPA_API __declspec(dllimport)
+	#endif
+#else
+	#define PAPA_API
+#endif
+
+// Goes up when a function is added, existing ones don't change.
+#define PAPA_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct papa_file papa_file;
+
+PAPA_API int papa_api_version(void);
+
+// Returns NULL if the file can't be read, with the reason in error if that
+// isn't NULL.
+PAPA_API papa_file *papa_open(const char *filename, char *error, size_t errorsize);
+PAPA_API void papa_close(papa_file *papa);
+PAPA_API const char *papa_error(papa_file *papa);
+
+PAPA_API int papa_texture_count(papa_file *papa);
+PAPA_API int papa_mip_count(papa_file *papa, int texture);
+PAPA_API int papa_size(papa_file *papa, int texture, int mip, int *width, int *height);
+PAPA_API const char *papa_format(papa_file *papa);
+PAPA_API int papa_can_encode(papa_file *papa);
+
+// The buffer needs room for 4 * width * height bytes of the mipmap.
+PAPA_API int papa_decode(papa_file *papa, int texture, int mip, unsigned char *buffer, size_t buffersize);
+
+// Replaces the texture, which has to be the same size, and regenerates its
+// mipmaps. pixels holds 4 * width * height bytes, and a size that doesn't
+// match the texture fails without reading them. Nothing is written until
+// papa_save.
+PAPA_API int papa_encode(papa_file *papa, int texture, const unsigned char *pixels, int width, int height);
+
+// Saves to filename, or back to the file it was opened from if that's NULL.
+PAPA_API int papa_save(papa_file *papa, const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PAPA_H
@@ -0,0 +1,417 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Times the decoders and encoders in PapaFile, over generated textures of
+// every format and size asked for and optionally over real files. Prints a
+// table, and with --json the same numbers for comparing between commits.
+
+#include <stdlib.h>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include "papafile.h"
+#include "papakernels.h"
+#include "papagenerator.h"
+#include "perfbaseline.h"
+#include <algorithm>
+
+// Counts every malloc, which covers Qt's allocations as well as new.
+#if defined(__GLIBC__)
+static volatile long MallocCalls = 0;
+
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) __THROW
+{
+	__sync_fetch_and_add(&MallocCalls, 1);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) __THROW
+{
+	__sync_fetch_and_add(&MallocCalls, 1);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) __THROW
+{
+	__sync_fetch_and_add(&MallocCalls, 1);
+	return __libc_realloc(pointer, size);
+}
+}
+
+static const bool CountsAllocations = true;
+static qint64 allocations() {return MallocCalls;}
+#else
+static const bool CountsAllocations = false;
+static qint64 allocations() {return 0;}
+#endif
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+class Operation
+{
+public:
+	virtual ~Operation() {}
+	virtual bool run() = 0;
+};
+
+// Every mipmap of every texture, without keeping the images.
+class DecodeOperation : public Operation
+{
+public:
+	DecodeOperation(PapaFile *papa) : Papa(papa) {}
+
+	virtual bool run()
+	{
+		for(int t = 0; t < Papa->textureCount(); t++)
+		{
+			for(int m = 0; m < Papa->mipCount(t); m++)
+			{
+				if(Papa->mipmap(t, m).isNull())
+					return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	PapaFile *Papa;
+};
+
+// The whole file, the images are decoded by the warm up call.
+class EncodeOperation : public Operation
+{
+public:
+	EncodeOperation(PapaFile *papa) : Papa(papa) {}
+
+	virtual bool run()
+	{
+		QByteArray contents;
+		return Papa->encode(contents);
+	}
+
+private:
+	PapaFile *Papa;
+};
+
+struct result_t
+{
+	QString Operation;
+	QString Format;
+	QString Source;
+	int Width;
+	int Height;
+	int Mipmaps;
+	qint64 Bytes; // Of texture data, summed over the mipmaps
+	qint64 Texels;
+	qint64 Blocks; // 4x4
+	int Calls;
+	double Seconds; // Per call
+	double Allocations; // Per call
+};
+
+static bool measure(Operation& operation, double mintime, result_t& result)
+{
+	// One call to warm up, then as many as fit in the time.
+	if(!operation.run())
+		return false;
+
+	QElapsedTimer timer;
+	qint64 allocated = allocations();
+	timer.start();
+	int calls = 0;
+	do
+	{
+		if(!operation.run())
+			return false;
+		calls++;
+	}
+	while(timer.nsecsElapsed() < mintime * 1e9);
+
+	result.Calls = calls;
+	result.Seconds = timer.nsecsElapsed() / 1e9 / calls;
+	result.Allocations = double(allocations() - allocated) / calls;
+	return true;
+}
+
+static void describe(const QString& filename, result_t& result)
+{
+	// Sizes from the headers, the same for decoding and encoding.
+	PapaFile::info_t info;
+	QString error;
+	result.Bytes = result.Texels = result.Blocks = 0;
+	result.Width = result.Height = result.Mipmaps = 0;
+	if(!PapaFile::inspect(filename, info, error) || info.Textures.isEmpty())
+		return;
+
+	result.Format = PapaFile::formatName(info.Textures[0].Format);
+	result.Width = info.Textures[0].Width;
+	result.Height = info.Textures[0].Height;
+	result.Mipmaps = info.Textures[0].Mipmaps;
+	for(int t = 0; t < info.Textures.count(); t++)
+	{
+		const PapaFile::textureinfo_t& texture = info.Textures[t];
+		result.Bytes += texture.Length;
+		for(int m = 0; m < texture.Mipmaps; m++)
+		{
+			int width = std::max(1, texture.Width >> m);
+			int height = std::max(1, texture.Height >> m);
+			result.Texels += (qint64)width * height;
+			result.Blocks += (qint64)((width + 3) / 4) * ((height + 3) / 4);
+		}
+	}
+}
+
+static void print(const result_t& result)
+{
+	QString allocations = CountsAllocations ? QString("%1 allocs/call").arg(result.Allocations, 0, 'f', 1) : QString();
+	out << QString("%1 %2 %3 %4 mips %5 MB/s %6 Mblocks/s %7 ns/texel %8")
+		.arg(result.Operation, -6)
+		.arg(result.Format, -8)
+		.arg(result.Source, -24)
+		.arg(result.Mipmaps, 2)
+		.arg(result.Bytes / result.Seconds / (1024 * 1024), 9, 'f', 1)
+		.arg(result.Blocks / result.Seconds / 1e6, 8, 'f', 2)
+		.arg(result.Seconds * 1e9 / std::max(result.Texels, (qint64)1), 8, 'f', 2)
+		.arg(allocations) << '\n';
+	out.flush();
+}
+
+static QString json(const QString& text)
+{
+	QString escaped = text;
+	escaped.replace('\\', "\\\\");
+	escaped.replace('"', "\\\"");
+	return '"' + escaped + '"';
+}
+
+static QString json(const result_t& result)
+{
+	return QString("{\"operation\":%1,\"format\":%2,\"source\":%3,\"width\":%4,\"height\":%5,\"mipmaps\":%6,\"bytes\":%7,\"texels\":%8,\"blocks\":%9,")
+			.arg(json(result.Operation))
+			.arg(json(result.Format))
+			.arg(json(result.Source))
+			.arg(result.Width)
+			.arg(result.Height)
+			.arg(result.Mipmaps)
+			.arg(result.Bytes)
+			.arg(result.Texels)
+			.arg(result.Blocks)
+		+ QString("\"calls\":%1,\"seconds_per_call\":%2,\"mb_per_s\":%3,\"blocks_per_s\":%4,\"ns_per_texel\":%5,\"allocations_per_call\":%6}")
+			.arg(result.Calls)
+			.arg(result.Seconds, 0, 'g', 6)
+			.arg(result.Bytes / result.Seconds / (1024 * 1024), 0, 'f', 2)
+			.arg(result.Blocks / result.Seconds, 0, 'f', 0)
+			.arg(result.Seconds * 1e9 / std::max(result.Texels, (qint64)1), 0, 'f', 3)
+			.arg(CountsAllocations ? QString::number(result.Allocations, 'f', 1) : QString("null"));
+}
+
+// Decodes and, if the format can be encoded, encodes one file.
+static bool benchmark(const QString& filename, const QString& source, bool synthetic, double mintime, QList<result_t>& results)
+{
+	result_t result;
+	result.Source = source;
+	describe(filename, result);
+
+	{
+		PapaFile papa(filename);
+		if(!papa.isValid() || !papa.preload())
+		{
+			err << filename << ": " << papa.lastError() << '\n';
+			return false;
+		}
+
+		DecodeOperation decode(&papa);
+		result.Operation = "decode";
+		if(!measure(decode, mintime, result))
+		{
+			err << filename << ": " << papa.lastError() << '\n';
+			return false;
+		}
+		results.append(result);
+		print(result);
+	}
+
+	PapaFile papa(filename);
+	if(!papa.isValid() || !papa.canEncode())
+		return true;
+
+	// The generated data of the compressed formats is noise, so those get a
+	// generated picture to encode like a real texture would be.
+	if(synthetic && !papa.importImage(PapaGenerator::image(result.Width, result.Height, 1), 0))
+	{
+		err << filename << ": " << papa.lastError() << '\n';
+		return false;
+	}
+
+	EncodeOperation encode(&papa);
+	result.Operation = "encode";
+	if(!measure(encode, mintime, result))
+	{
+		err << filename << ": " << papa.lastError() << '\n';
+		return false;
+	}
+	results.append(result);
+	print(result);
+	return true;
+}
+
+static QString takeOption(QStringList& arguments, const QString& name, const QString& defaultvalue)
+{
+	int index = arguments.indexOf(name);
+	if(index < 0 || index + 1 >= arguments.count())
+		return defaultvalue;
+
+	QString value = arguments[index + 1];
+	arguments.removeAt(index);
+	arguments.removeAt(index);
+	return value;
+}
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	arguments.removeFirst();
+
+	QStringList sizes = takeOption(arguments, "--sizes", "64,256,1024,2048,1000x600").split(',');
+	QStringList formats = takeOption(arguments, "--formats", "A8R8G8B8,X8R8G8B8,DXT1,DXT5").split(',');
+	QString real = takeOption(arguments, "--real", QString());
+	int limit = takeOption(arguments, "--limit", "20").toInt();
+	double mintime = takeOption(arguments, "--time", "0.5").toDouble();
+	QString jsonfile = takeOption(arguments, "--json", QString());
+	QString label = takeOption(arguments, "--label", QString());
+	QString baselinefile = takeOption(arguments, "--baseline", QString());
+	double tolerance = takeOption(arguments, "--tolerance", "10").toDouble();
+	bool update = (arguments.removeAll("--update-baseline") > 0);
+	if(!arguments.isEmpty())
+	{
+		err << "Usage: papa_bench [--sizes 64,256,WxH,...] [--formats DXT1,...] [--real <directory>] [--limit files]\n"
+		       "                  [--time seconds] [--json <file>] [--label text]\n"
+		       "                  [--baseline <file> [--tolerance percent] [--update-baseline]]\n";
+		return 2;
+	}
+
+	QList<result_t> results;
+	bool success = true;
+	out << "Kernels: " << PapaKernels::active().Name << " (PAPA_KERNELS selects others)\n";
+
+	QDir temporary(QDir::temp().absoluteFilePath(QString("papa_bench-%1").arg(QCoreApplication::applicationPid())));
+	QDir().mkpath(temporary.absolutePath());
+	for(QStringList::const_iterator formatname = formats.constBegin(); formatname != formats.constEnd(); ++formatname)
+	{
+		int format = 0;
+		while(format < 64 && PapaFile::formatName(format) != *formatname)
+			format++;
+		if(format == 64)
+		{
+			err << "Unknown format " << *formatname << '\n';
+			success = false;
+			continue;
+		}
+
+		for(QStringList::const_iterator size = sizes.constBegin(); size != sizes.constEnd(); ++size)
+		{
+			QStringList dimensions = size->split('x');
+			PapaGenerator::texturespec_t texture;
+			texture.Format = format;
+			texture.Width = dimensions[0].toInt();
+			texture.Height = dimensions.count() > 1 ? dimensions[1].toInt() : texture.Width;
+			texture.Mipmaps = 0;
+			texture.SRGB = false;
+
+			QString filename = temporary.absoluteFilePath(QString("%1_%2.papa").arg(*formatname).arg(*size));
+			QString error;
+			if(!PapaGenerator::write(filename, QList<PapaGenerator::texturespec_t>() << texture, QStringList("bench"), 1, error))
+			{
+				err << filename << ": " << error << '\n';
+				success = false;
+				continue;
+			}
+			success &= benchmark(filename, QString("%1x%2").arg(texture.Width).arg(texture.Height), true, mintime, results);
+			QFile::remove(filename);
+		}
+	}
+	QDir().rmdir(temporary.absolutePath());
+
+	if(!real.isEmpty())
+	{
+		QStringList filenames;
+		QDirIterator entry(real, QStringList("*.papa"), QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+		while(entry.hasNext())
+			filenames.append(entry.next());
+		filenames.sort();
+
+		for(int i = 0; i < std::min(limit, filenames.count()); i++)
+			success &= benchmark(filenames[i], QDir(real).relativeFilePath(filenames[i]), false, mintime, results);
+	}
+
+	if(!jsonfile.isEmpty())
+	{
+		QFile file(jsonfile);
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		{
+			err << jsonfile << ": " << file.errorString() << '\n';
+			return 1;
+		}
+
+		QTextStream stream(&file);
+		stream << "{\"label\":" << json(label) << ",\"encoder_version\":" << PapaFile::EncoderVersion << ",\"kernels\":" << json(PapaKernels::active().Name) << ",\"results\":[\n";
+		for(int i = 0; i < results.count(); i++)
+			stream << json(results[i]) << (i + 1 < results.count() ? ",\n" : "\n");
+		stream << "]}\n";
+	}
+
+	// Decoders are judged by how much they get through, the encoders by the
+	// blocks since that is what they spend their time on.
+	if(!baselinefile.isEmpty())
+	{
+		PerfBaseline measured;
+		for(int i = 0; i < results.count(); i++)
+		{
+			const result_t& result = results[i];
+			QString name = QString("%1/%2/%3").arg(result.Operation).arg(result.Format).arg(result.Source);
+			if(result.Operation == "decode")
+				measured.add(name + "/mb_per_s", result.Bytes / result.Seconds / (1024 * 1024), true);
+			else
+				measured.add(name + "/blocks_per_s", result.Blocks / result.Seconds, true);
+		}
+		if(PerfBaseline::peakResidentKb() >= 0)
+			measured.add("peak_resident_kb", PerfBaseline::peakResidentKb(), false);
+
+		QStringList report;
+		success &= measured.check(baselinefile, tolerance, update, report);
+		for(QStringList::const_iterator line = report.constBegin(); line != report.constEnd(); ++line)
+			out << *line << '\n';
+		out.flush();
+	}
+
+	err.flush();
+	return success ? 0 : 1;
+}
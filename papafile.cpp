@@ -18,10 +18,15 @@
  */
 
 #include "papafile.h"
+#include "papakernels.h"
 #include <QFile>
+#include <QBuffer>
 #include <QImage>
 #include <QColor>
+#include <QVector>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 
 PapaFile::PapaFile(const QString& filename)
 {
@@ -41,12 +46,50 @@ PapaFile::~PapaFile()
 void PapaFile::init()
 {
 	Valid = false;
-	Modified = false;
+	Modified = 0;
 	LastError = "";
+	Cancelled = 0;
+	ProgressDone = 0;
+	ProgressTotal = 0;
+	ProgressReported = -1;
+	EncoderOptions = defaultEncoderOptions();
+}
+
+PapaFile::encoderoptions_t PapaFile::defaultEncoderOptions()
+{
+	encoderoptions_t options;
+	options.Dither = true;
+	options.Iterations = 100;
+	return options;
+}
+
+void PapaFile::startProgress(qint64 total)
+{
+	ProgressDone = 0;
+	ProgressTotal = std::max(total, (qint64)1);
+	ProgressReported = -1;
+}
+
+bool PapaFile::advanceProgress(qint64 amount)
+{
+	// Reported in steps of a tenth of a percent, so the receiver doesn't get
+	// swamped with queued signals for every block.
+	ProgressDone += amount;
+	int value = (int)(1000 * std::min(ProgressDone, ProgressTotal) / ProgressTotal);
+	if(value != ProgressReported)
+	{
+		ProgressReported = value;
+		emit progress(value, 1000);
+	}
+
+	return Cancelled == 0;
 }
 
 bool PapaFile::load(QString filename)
 {
+	QMutexLocker locker(&Mutex);
+	PapaStats::Timer timer(Stats, PapaStats::Load, filename);
+
 	Filename = filename;
 
 	QFile file(filename);
@@ -143,74 +186,34 @@ bool PapaFile::load(QString filename)
 			}
 
 			texture_t texture;
-			switch(textureinformationheader.TextureFormat)
+			if(!codec(textureinformationheader.TextureFormat))
 			{
-				case texture_t::A8R8G8B8:
-					texture.Format = texture_t::A8R8G8B8;
-					break;
-				case texture_t::X8R8G8B8:
-					texture.Format = texture_t::X8R8G8B8;
-					break;
-				case texture_t::DXT1:
-					texture.Format = texture_t::DXT1;
-					break;
-				case texture_t::DXT5:
-					texture.Format = texture_t::DXT5;
-					break;
-				default:
-					texture.Format = texture_t::Invalid;
+				LastError = QString("Failed to decode unsupported texture data for texture %1").arg(i);
+				return false;
 			}
+			texture.Format = (texture_t::format_t)textureinformationheader.TextureFormat;
 			texture.Width = textureinformationheader.Width;
 			texture.Height = textureinformationheader.Height;
-			texture.Data = file.read(textureinformationheader.Length);
 			texture.NumberMinimaps = (int)textureinformationheader.NumberMinimaps;
 			texture.sRGB = (textureinformationheader.SRGB == 1);
-			if(texture.Data.length() != textureinformationheader.Length)
-			{
-				LastError = QString("Failed to read texture data for texture %1").arg(i);
-				return false;
-			}
 			texture.Unknowns.Unknown1[0] = textureinformationheader.Unknown1[0];
 			texture.Unknowns.Unknown1[1] = textureinformationheader.Unknown1[1];
 			texture.Unknowns.Unknown2 = textureinformationheader.Unknown2;
 			texture.Unknowns.Unknown3 = textureinformationheader.Unknown3;
 
-			switch(texture.Format)
+			// The texture data is only read and decoded once it is needed.
+			texture.DataOffset = file.pos();
+			texture.DataLength = textureinformationheader.Length;
+			for(int m = 0; m < texture.NumberMinimaps; m++)
+				texture.Image.push_back(QImage());
+			if(file.size() < texture.DataOffset + texture.DataLength || !file.seek(texture.DataOffset + texture.DataLength))
 			{
-				case texture_t::A8R8G8B8:
-					if(!decodeA8R8G8B8(texture))
-					{
-						LastError = QString("Failed to decode A8R8G8B8 texture data for texture %1").arg(i);
-						return false;
-					}
-					break;
-				case texture_t::X8R8G8B8:
-					if(!decodeX8R8G8B8(texture))
-					{
-						LastError = QString("Failed to decode X8R8G8B8 texture data for texture %1").arg(i);
-						return false;
-					}
-					break;
-				case texture_t::DXT1:
-					if(!decodeDXT1(texture))
-					{
-						LastError = QString("Failed to decode DXT1 texture data for texture %1").arg(i);
-						return false;
-					}
-					break;
-				case texture_t::DXT5:
-					if(!decodeDXT5(texture))
-					{
-						LastError = QString("Failed to decode DXT5 texture data for texture %1").arg(i);
-						return false;
-					}
-					break;
-				default:
-					LastError = QString("Failed to decode unsupported texture data for texture %1").arg(i);
-					return false;
+				LastError = QString("Failed to read texture data for texture %1").arg(i);
+				return false;
 			}
 
 			Textures.push_back(texture);
+			Headers.push_back(texture);
 		}
 	}
 
@@ -220,6 +223,147 @@ bool PapaFile::load(QString filename)
 	return true;
 }
 
+QSize PapaFile::mipSize(const PapaFile::texture_t& texture, int mipindex)
+{
+	return QSize(std::max(1, texture.Width >> mipindex), std::max(1, texture.Height >> mipindex));
+}
+
+qint64 PapaFile::mipLength(const PapaFile::texture_t& texture, int mipindex)
+{
+	const codec_t *formatcodec = codec(texture.Format);
+	if(!formatcodec)
+		return 0;
+
+	QSize size = mipSize(texture, mipindex);
+	int blocksize = formatcodec->BlockSize;
+	return (qint64)((size.width() + blocksize - 1) / blocksize) * ((size.height() + blocksize - 1) / blocksize) * formatcodec->BlockBytes;
+}
+
+qint64 PapaFile::mipOffset(const PapaFile::texture_t& texture, int mipindex)
+{
+	qint64 offset = 0;
+	for(int m = 0; m < mipindex; m++)
+		offset += mipLength(texture, m);
+
+	return offset;
+}
+
+bool PapaFile::readData(int textureindex)
+{
+	texture_t &texture = Textures[textureindex];
+	if(texture.Data.length() == texture.DataLength)
+		return true;
+
+	PapaStats::Timer timer(Stats, PapaStats::Read, Filename);
+	QFile file(Filename);
+	if(!file.open(QIODevice::ReadOnly) || !file.seek(texture.DataOffset))
+	{
+		LastError = "Couldn't open file";
+		return false;
+	}
+
+	texture.Data = file.read(texture.DataLength);
+	Stats.add(PapaStats::BytesRead, texture.Data.length());
+	Stats.add(PapaStats::Allocations);
+	if(texture.Data.length() != texture.DataLength)
+	{
+		texture.Data.clear();
+		LastError = QString("Failed to read texture data for texture %1").arg(textureindex);
+		return false;
+	}
+
+	return true;
+}
+
+bool PapaFile::readMipmap(int textureindex, int mipindex, QByteArray& data)
+{
+	// Only read the part of the file that holds this mipmap, unless the
+	// whole texture is in memory already.
+	const texture_t &texture = Textures[textureindex];
+	qint64 offset = mipOffset(texture, mipindex);
+	qint64 length = mipLength(texture, mipindex);
+	if(offset + length > texture.DataLength)
+	{
+		LastError = QString("Texture data is too short for mipmap %1 of texture %2").arg(mipindex).arg(textureindex);
+		return false;
+	}
+	Stats.add(PapaStats::Allocations);
+	if(texture.Data.length() == texture.DataLength)
+	{
+		data = texture.Data.mid(offset, length);
+		return true;
+	}
+
+	PapaStats::Timer timer(Stats, PapaStats::Read, Filename);
+	QFile file(Filename);
+	if(!file.open(QIODevice::ReadOnly) || !file.seek(texture.DataOffset + offset))
+	{
+		LastError = "Couldn't open file";
+		return false;
+	}
+
+	data = file.read(length);
+	Stats.add(PapaStats::BytesRead, data.length());
+	if(data.length() != length)
+	{
+		LastError = QString("Failed to read mipmap %1 of texture %2").arg(mipindex).arg(textureindex);
+		return false;
+	}
+
+	return true;
+}
+
+bool PapaFile::decode(int textureindex)
+{
+	for(int m = 0; m < Textures[textureindex].NumberMinimaps; m++)
+	{
+		if(!decode(textureindex, m))
+			return false;
+	}
+
+	return Textures[textureindex].NumberMinimaps > 0;
+}
+
+bool PapaFile::decode(int textureindex, int mipindex)
+{
+	texture_t &texture = Textures[textureindex];
+	if(!texture.Image[mipindex].isNull())
+		return true;
+
+	if(!readData(textureindex))
+		return false;
+
+	if(mipOffset(texture, mipindex) + mipLength(texture, mipindex) > texture.DataLength)
+	{
+		LastError = QString("Texture data is too short for mipmap %1 of texture %2").arg(mipindex).arg(textureindex);
+		return false;
+	}
+
+	return decodeMipmap(textureindex, mipindex, texture.Data.constData() + mipOffset(texture, mipindex), texture.Image[mipindex]);
+}
+
+bool PapaFile::decodeMipmap(int textureindex, int mipindex, const char *data, QImage& image)
+{
+	const texture_t &texture = Textures[textureindex];
+	PapaStats::Timer timer(Stats, PapaStats::Decode, Filename);
+	QSize size = mipSize(texture, mipindex);
+	Stats.add(PapaStats::BlocksDecoded, ((size.width() + 3) / 4) * ((size.height() + 3) / 4));
+	Stats.add(PapaStats::Allocations);
+	const codec_t *formatcodec = codec(texture.Format);
+	if(!formatcodec)
+	{
+		LastError = QString("Failed to decode unsupported texture data for texture %1").arg(textureindex);
+		return false;
+	}
+	if(!(this->*formatcodec->Decode)(texture, mipindex, data, image))
+	{
+		LastError = QString("Failed to decode %1 texture data for texture %2").arg(formatcodec->Name).arg(textureindex);
+		return false;
+	}
+
+	return true;
+}
+
 bool PapaFile::save(QString filename)
 {
 	if(filename == "")
@@ -228,12 +372,139 @@ bool PapaFile::save(QString filename)
 	if(!Modified && filename == Filename)
 		return true;
 
-	QFile papafile(filename);
-	if(!papafile.open(QIODevice::ReadWrite))
+	if(!write(filename))
+		return false;
+
+	markSaved(filename);
+	return true;
+}
+
+void PapaFile::markSaved(const QString& filename)
+{
+	QMutexLocker locker(&Mutex);
+
+	if(filename == WrittenFilename)
+	{
+		for(int i = 0; i < Textures.count() && i < EncodedOffsets.count(); i++)
+			Textures[i].DataOffset = EncodedOffsets[i];
+	}
+
+	Filename = filename;
+	Modified = 0;
+}
+
+bool PapaFile::write(const QString& filename)
+{
+	// Doesn't touch Filename or Modified, so this can run on a worker thread
+	// while the model keeps using them. See markSaved.
+	QByteArray contents;
+	return encode(contents) && store(filename, contents);
+}
+
+bool PapaFile::store(const QString& filename, const QByteArray& contents)
+{
+	QMutexLocker locker(&Mutex);
+	PapaStats::Timer timer(Stats, PapaStats::Store, filename);
+
+	QFile file(filename);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
 	{
 		LastError = QString("Failed to open %1").arg(filename);
 		return false;
 	}
+	if(file.write(contents) != contents.length())
+	{
+		LastError = QString("Failed to write %1").arg(filename);
+		return false;
+	}
+	Stats.add(PapaStats::BytesWritten, contents.length());
+
+	// The data can be dropped and read back later, so remember where it went.
+	// A copy saved elsewhere only counts once markSaved switches to it.
+	WrittenFilename = filename;
+	if(filename == Filename)
+	{
+		for(int i = 0; i < Textures.count() && i < EncodedOffsets.count(); i++)
+			Textures[i].DataOffset = EncodedOffsets[i];
+	}
+
+	return true;
+}
+
+bool PapaFile::encode(QByteArray& contents)
+{
+	// Builds the whole file in memory, nothing is written to disk here.
+	QMutexLocker locker(&Mutex);
+	PapaStats::Timer timer(Stats, PapaStats::Encode, Filename);
+
+	qint64 pixels = 0;
+	qint64 blocks = 0;
+	for(int i = 0; i < Textures.count(); i++)
+	{
+		for(int m = 0; m < Textures[i].NumberMinimaps; m++)
+		{
+			QSize size = mipSize(Textures[i], m);
+			pixels += size.width() * size.height();
+			blocks += ((size.width() + 3) / 4) * ((size.height() + 3) / 4);
+		}
+	}
+	startProgress(2 * pixels);
+
+	// Everything has to be in memory before the file gets overwritten.
+	for(int i = 0; i < Textures.count(); i++)
+	{
+		if(!readData(i))
+			return false;
+		for(int m = 0; m < Textures[i].NumberMinimaps; m++)
+		{
+			if(!decode(i, m))
+				return false;
+			if(!advanceProgress(mipSize(Textures[i], m).width() * mipSize(Textures[i], m).height()))
+			{
+				LastError = "Cancelled.";
+				return false;
+			}
+		}
+	}
+
+	// Encode into copies first, so cancelling or failing halfway leaves both
+	// the file and the texture data alone.
+	QList<texture_t> encoded = Textures;
+	for(QList<texture_t>::iterator tex = encoded.begin(); tex != encoded.end(); ++tex)
+	{
+		const codec_t *formatcodec = codec(tex->Format);
+		if(!formatcodec || !formatcodec->Encode)
+		{
+			LastError = QString("Encoding not supported in format %1").arg(tex->Format);
+			return false;
+		}
+		// The encoders write straight into the data, which a header with too
+		// short a Length would have them run off the end of.
+		if(tex->Data.length() < mipOffset(*tex, tex->NumberMinimaps))
+		{
+			LastError = QString("The texture data of texture %1 is too short for its mipmaps").arg(tex - encoded.begin());
+			return false;
+		}
+		bool success = (this->*formatcodec->Encode)(*tex);
+
+		if(Cancelled)
+		{
+			LastError = "Cancelled.";
+			return false;
+		}
+		if(!success)
+		{
+			LastError = QString("Encoding texture in %1 failed.").arg(format());
+			return false;
+		}
+	}
+
+	Stats.add(PapaStats::BlocksEncoded, blocks);
+	Stats.add(PapaStats::Allocations, encoded.count() + 1); // The texture data copies and the file
+
+	contents.clear();
+	QBuffer papafile(&contents);
+	papafile.open(QIODevice::WriteOnly);
 
 	Header papaheader;
 	papaheader.Identification[0] = 'a';
@@ -274,43 +545,8 @@ bool PapaFile::save(QString filename)
 		return false;
 	}
 
-	for(QList<texture_t>::iterator tex = Textures.begin(); tex != Textures.end(); ++tex)
+	for(QList<texture_t>::iterator tex = encoded.begin(); tex != encoded.end(); ++tex)
 	{
-		switch(tex->Format)
-		{
-			case texture_t::A8R8G8B8:
-				if(!encodeA8R8G8B8(*tex))
-				{
-					LastError = "Encoding texture in A8R8G8B8 failed.";
-					return false;
-				}
-				break;
-			case texture_t::X8R8G8B8:
-				if(!encodeX8R8G8B8(*tex))
-				{
-					LastError = "Encoding texture in X8R8G8B8 failed.";
-					return false;
-				}
-				break;
-			case texture_t::DXT1:
-				if(!encodeDXT1(*tex))
-				{
-					LastError = "Encoding texture in DXT1 failed.";
-					return false;
-				}
-				break;
-			case texture_t::DXT5:
-				if(!encodeDXT5(*tex))
-				{
-					LastError = "Encoding texture in DXT5 failed.";
-					return false;
-				}
-				break;
-			default:
-				LastError = QString("Encoding not supported in format %1").arg(tex->Format);
-				return false;
-		}
-
 		TextureInformationHeader textureinformationheader;
 		textureinformationheader.Unknown1[0] = tex->Unknowns.Unknown1[0];
 		textureinformationheader.Unknown1[1] = tex->Unknowns.Unknown1[1];
@@ -328,6 +564,7 @@ bool PapaFile::save(QString filename)
 			LastError = "Failed to write texture information header for texture.";
 			return false;
 		}
+		tex->DataOffset = papafile.pos();
 		if(papafile.write(tex->Data) != tex->Data.length())
 		{
 			LastError = "Failed to write data for texture.";
@@ -372,29 +609,50 @@ bool PapaFile::save(QString filename)
 		return false;
 	}
 
-	Filename = filename;
-	LastError = "";
-	Modified = false;
+	EncodedOffsets.clear();
+	for(int i = 0; i < Textures.count(); i++)
+	{
+		Textures[i].Data = encoded[i].Data;
+		EncodedOffsets.append(encoded[i].DataOffset);
+	}
 
+	LastError = "";
 	return true;
 }
 
 
-void PapaFile::findOptimalColours(PapaFile::colour_t& colour0, PapaFile::colour_t& colour1, const QList<colour_t> &colours)
+// From 0 to 1, in linear light for sRGB textures so the encoder measures
+// the errors the way they will be seen.
+void PapaFile::colourChannels(PapaFile::colour_t colour, bool srgb, float& red, float& green, float& blue)
+{
+	if(srgb)
+	{
+		const PapaKernels::srgbtables_t& tables = PapaKernels::srgb();
+		red = tables.ToLinear[DxtExpand5[colour.rgb.red]] / 4095.f;
+		green = tables.ToLinear[DxtExpand6[colour.rgb.green]] / 4095.f;
+		blue = tables.ToLinear[DxtExpand5[colour.rgb.blue]] / 4095.f;
+	}
+	else
+	{
+		red = colour.rgb.red / 32.;
+		green = colour.rgb.green / 64.;
+		blue = colour.rgb.blue / 32.;
+	}
+}
+
+void PapaFile::findOptimalColours(PapaFile::colour_t& colour0, PapaFile::colour_t& colour1, const QList<colour_t> &colours, int iterations, bool srgb)
 {
 	// Find extreme colours
 	float maxdistance = 0;
 	int col0 = -1, col1 = -1;
 	for(int i = 0; i < colours.count(); i++)
 	{
-		float ri = colours[i].rgb.red / 32.;
-		float gi = colours[i].rgb.green / 64.;
-		float bi = colours[i].rgb.blue / 32.;
+		float ri, gi, bi;
+		colourChannels(colours[i], srgb, ri, gi, bi);
 		for(int j = i + 1; j < colours.count(); j++)
 		{
-			float rj = colours[j].rgb.red / 32.;
-			float gj = colours[j].rgb.green / 64.;
-			float bj = colours[j].rgb.blue / 32.;
+			float rj, gj, bj;
+			colourChannels(colours[j], srgb, rj, gj, bj);
 
 			float distance = (ri - rj) * (ri - rj) + (gi - gj) * (gi - gj) + (bi - bj) * (bi - bj);
 
@@ -411,9 +669,9 @@ void PapaFile::findOptimalColours(PapaFile::colour_t& colour0, PapaFile::colour_
 
 	colour_t bestcolour0 = colours[col0];
 	colour_t bestcolour1 = colours[col1];
-	float lowestchi2 = calculateChi2_four(bestcolour0, bestcolour1, colours);
+	float lowestchi2 = calculateChi2_four(bestcolour0, bestcolour1, colours, srgb);
 
-	for(int i = 0; i < 100; i++)
+	for(int i = 0; i < iterations; i++)
 	{
 		colour_t c0 = bestcolour0;
 		colour_t c1 = bestcolour1;
@@ -423,7 +681,7 @@ void PapaFile::findOptimalColours(PapaFile::colour_t& colour0, PapaFile::colour_
 		c1.rgb.red += (5.0 * rand()) / RAND_MAX - 2.5;
 		c1.rgb.green += (5.0 * rand()) / RAND_MAX - 2.5;
 		c1.rgb.blue += (5.0 * rand()) / RAND_MAX - 2.5;
-		float chi2 = calculateChi2_four(c0, c1, colours);
+		float chi2 = calculateChi2_four(c0, c1, colours, srgb);
 
 		if(chi2 < lowestchi2)
 		{
@@ -449,7 +707,7 @@ inline float colourDistance(const colour_t &col1, const colour_t &col2)
 {
 }
 */
-float PapaFile::calculateChi2_four(colour_t col1, colour_t col2, const QList<colour_t> &colours)
+float PapaFile::calculateChi2_four(colour_t col1, colour_t col2, const QList<colour_t> &colours, bool srgb)
 {
 	colour_t colourts[4];
 	colourts[0].value = col1.value;
@@ -464,15 +722,13 @@ float PapaFile::calculateChi2_four(colour_t col1, colour_t col2, const QList<col
 	float chi2 = 0;
 	for(QList<colour_t>::const_iterator col = colours.constBegin(); col != colours.constEnd(); ++col)
 	{
-		float rcol = col->rgb.red / 32.;
-		float gcol = col->rgb.green / 64.;
-		float bcol = col->rgb.blue / 32.;
+		float rcol, gcol, bcol;
+		colourChannels(*col, srgb, rcol, gcol, bcol);
 		float mindistance = 9999999999;
 		for(int i = 0; i < 4; i++)
 		{
-			float ri = colourts[i].rgb.red / 32.;
-			float gi = colourts[i].rgb.green / 64.;
-			float bi = colourts[i].rgb.blue / 32.;
+			float ri, gi, bi;
+			colourChannels(colourts[i], srgb, ri, gi, bi);
 			float distance = (ri - rcol) * (ri - rcol) + (gi - gcol) * (gi - gcol) + (bi - bcol) * (bi - bcol);
 
 			if(distance < mindistance)
@@ -485,17 +741,26 @@ float PapaFile::calculateChi2_four(colour_t col1, colour_t col2, const QList<col
 	return chi2;
 }
 
-quint8 PapaFile::findClosestColour(QRgb pixelcolour, QRgb* palette)
+quint8 PapaFile::findClosestColour(QRgb pixelcolour, QRgb* palette, bool srgb)
 {
+	// Compared in linear light for sRGB textures, 12 bits per channel.
+	const quint32 *linear = srgb ? PapaKernels::srgb().ToLinear : NULL;
+	int red = linear ? linear[qRed(pixelcolour)] : qRed(pixelcolour);
+	int green = linear ? linear[qGreen(pixelcolour)] : qGreen(pixelcolour);
+	int blue = linear ? linear[qBlue(pixelcolour)] : qBlue(pixelcolour);
+
 	quint8 closestindex = 255;
 	float distance = 99999999999999;
 	for(quint8 i = 0; i < 4; i++)
 	{
+		int palettered = linear ? linear[qRed(palette[i])] : qRed(palette[i]);
+		int palettegreen = linear ? linear[qGreen(palette[i])] : qGreen(palette[i]);
+		int paletteblue = linear ? linear[qBlue(palette[i])] : qBlue(palette[i]);
 		float distance2 =
-			(qRed(pixelcolour) - qRed(palette[i])) * (qRed(pixelcolour) - qRed(palette[i])) +
-			(qGreen(pixelcolour) - qGreen(palette[i])) * (qGreen(pixelcolour) - qGreen(palette[i])) +
-			(qBlue(pixelcolour) - qBlue(palette[i])) * (qBlue(pixelcolour) - qBlue(palette[i]));
-			
+			(float)(red - palettered) * (red - palettered) +
+			(float)(green - palettegreen) * (green - palettegreen) +
+			(float)(blue - paletteblue) * (blue - paletteblue);
+
 		if(distance2 < distance)
 		{
 			distance = distance2;
@@ -507,184 +772,110 @@ quint8 PapaFile::findClosestColour(QRgb pixelcolour, QRgb* palette)
 }
 
 
-bool PapaFile::decodeA8R8G8B8(PapaFile::texture_t& texture)
-{
-	int offset = 0;
+// The layouts the codec knows. Adding a format is a specialisation here
+// and a line in codec() below.
+//
+// The images hold the texture's own values, sRGB ones aren't converted.
+// They are what an image viewer expects already, and it keeps decoding and
+// encoding lossless. The sRGB bit matters where pixels are averaged or
+// compared: making mipmaps and picking DXT1 colours.
 
-	for(int m = 0; m < texture.NumberMinimaps; m++)
-	{
-		int divider = pow(2, m);
-		qint16 width = texture.Width / divider;
-		qint16 height = texture.Height / divider;
-		
-// TODO: Do something with the sRGB bit
-//		convertFromSRGB();
+template<> struct PapaFile::formattraits_t<PapaFile::texture_t::A8R8G8B8>
+{
+	enum {BlockSize = 1, BlockBytes = 4, Alpha = true};
+	static const QImage::Format ImageFormat = QImage::Format_ARGB32;
+};
 
-		QImage image = QImage(width, height, QImage::Format_ARGB32);
-		for(int j = 0; j < 4 * width * height; j += 4)
-		{
-			int pixelindex = j / 4;
-			image.setPixel(pixelindex % width, (pixelindex / width), qRgba(texture.Data[offset + j], texture.Data[offset + j+1], texture.Data[offset + j+2], texture.Data[offset + j+3]));
-		}
-		texture.Image.push_back(image);
-		offset += 4 * width * height;
-	}
+// Same as A8R8G8B8, but alpha remains unused. The fourth byte is kept as it
+// was when encoding.
+template<> struct PapaFile::formattraits_t<PapaFile::texture_t::X8R8G8B8>
+{
+	enum {BlockSize = 1, BlockBytes = 4, Alpha = false};
+	static const QImage::Format ImageFormat = QImage::Format_RGB32;
+};
 
-	return true;
-}
+template<> struct PapaFile::formattraits_t<PapaFile::texture_t::DXT1>
+{
+	enum {BlockSize = 4, BlockBytes = sizeof(PapaFile::DXT1)};
+	static const QImage::Format ImageFormat = QImage::Format_RGB32;
+	static PapaKernels::blockdecoder_t decoder(const PapaKernels::kernels_t& kernels) {return kernels.decodeDXT1;}
+};
 
-bool PapaFile::encodeA8R8G8B8(PapaFile::texture_t& texture)
+template<> struct PapaFile::formattraits_t<PapaFile::texture_t::DXT5>
 {
-	int offset = 0;
+	enum {BlockSize = 4, BlockBytes = sizeof(PapaFile::DXT5)};
+	static const QImage::Format ImageFormat = QImage::Format_ARGB32;
+	static PapaKernels::blockdecoder_t decoder(const PapaKernels::kernels_t& kernels) {return kernels.decodeDXT5;}
+};
 
-	for(int m = 0; m < texture.NumberMinimaps; m++)
+const PapaFile::codec_t *PapaFile::codec(int format)
+{
+	typedef formattraits_t<texture_t::A8R8G8B8> a8r8g8b8;
+	typedef formattraits_t<texture_t::X8R8G8B8> x8r8g8b8;
+	typedef formattraits_t<texture_t::DXT1> dxt1;
+	typedef formattraits_t<texture_t::DXT5> dxt5;
+	static const codec_t codecs[] = {
+		{texture_t::A8R8G8B8, "A8R8G8B8", a8r8g8b8::BlockSize, a8r8g8b8::BlockBytes, &PapaFile::decodeUncompressed<texture_t::A8R8G8B8>, &PapaFile::encodeUncompressed<texture_t::A8R8G8B8>},
+		{texture_t::X8R8G8B8, "X8R8G8B8", x8r8g8b8::BlockSize, x8r8g8b8::BlockBytes, &PapaFile::decodeUncompressed<texture_t::X8R8G8B8>, &PapaFile::encodeUncompressed<texture_t::X8R8G8B8>},
+		{texture_t::DXT1, "DXT1", dxt1::BlockSize, dxt1::BlockBytes, &PapaFile::decodeCompressed<texture_t::DXT1>, &PapaFile::encodeDXT1},
+		{texture_t::DXT5, "DXT5", dxt5::BlockSize, dxt5::BlockBytes, &PapaFile::decodeCompressed<texture_t::DXT5>, NULL}
+	};
+
+	for(unsigned int i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++)
 	{
-		int divider = pow(2, m);
-		qint16 width = texture.Width / divider;
-		qint16 height = texture.Height / divider;
-		
-// TODO: Do something with the sRGB bit
-//		convertFromSRGB();
-
-		QImage image = texture.Image[m];
-		for(int j = 0; j < 4 * width * height; j += 4)
-		{
-			int pixelindex = j / 4;
-			QRgb colour = image.pixel(pixelindex % width, pixelindex / width);
-			texture.Data[offset + j] = qRed(colour);
-			texture.Data[offset + j+1] = qGreen(colour);
-			texture.Data[offset + j+2] = qBlue(colour);
-			texture.Data[offset + j+3] = qAlpha(colour);
-		}
-		offset += 4 * width * height;
+		if(codecs[i].Format == format)
+			return &codecs[i];
 	}
-
-	return true;
+	return NULL;
 }
 
 
-bool PapaFile::decodeX8R8G8B8(PapaFile::texture_t& texture)
+template<int format> bool PapaFile::decodeUncompressed(const PapaFile::texture_t& texture, int mipindex, const char *data, QImage& image)
 {
-	// Same as A8R8G8B8, but alpha remains unused.
-
-	int offset = 0;
-
-	for(int m = 0; m < texture.NumberMinimaps; m++)
-	{
-		int divider = pow(2, m);
-		qint16 width = texture.Width / divider;
-		qint16 height = texture.Height / divider;
+	typedef formattraits_t<format> traits;
+	QSize size = mipSize(texture, mipindex);
+	int width = size.width();
+	int height = size.height();
 
-		QImage image = QImage(width, height, QImage::Format_RGB32);
-		for(int j = 0; j < 4 * width * height; j += 4)
-		{
-			int pixelindex = j / 4;
-			image.setPixel(pixelindex % width, (pixelindex / width), qRgb(texture.Data[offset + j], texture.Data[offset + j+1], texture.Data[offset + j+2]));
-		}
-		texture.Image.push_back(image);
-		offset += 4 * width * height;
-	}
+	image = QImage(width, height, traits::ImageFormat);
+	const PapaKernels::kernels_t& kernels = PapaKernels::active();
+	for(int y = 0; y < height; y++)
+		kernels.unpackRGBA((const uchar *)data + traits::BlockBytes * width * y, (quint32 *)image.scanLine(y), width, traits::Alpha);
 
 	return true;
 }
 
-bool PapaFile::encodeX8R8G8B8(PapaFile::texture_t& texture)
+template<int format> bool PapaFile::encodeUncompressed(PapaFile::texture_t& texture)
 {
+	typedef formattraits_t<format> traits;
+	const PapaKernels::kernels_t& kernels = PapaKernels::active();
 	int offset = 0;
 
 	for(int m = 0; m < texture.NumberMinimaps; m++)
 	{
-		int divider = pow(2, m);
-		qint16 width = texture.Width / divider;
-		qint16 height = texture.Height / divider;
+		QSize size = mipSize(texture, m);
+		int width = size.width();
+		int height = size.height();
 
-		QImage image = texture.Image[m];
-		for(int j = 0; j < 4 * width * height; j += 4)
-		{
-			int pixelindex = j / 4;
-			QRgb colour = image.pixel(pixelindex % width, pixelindex / width);
-			texture.Data[offset + j] = qRed(colour);
-			texture.Data[offset + j+1] = qGreen(colour);
-			texture.Data[offset + j+2] = qBlue(colour);
-//			texture.Data[offset + j+3] = <NOT USED>;
-		}
-		offset += 4 * width * height;
+		QImage image = rgbImage(texture.Image[m]);
+		for(int y = 0; y < height; y++)
+			kernels.packRGBA((const quint32 *)image.constScanLine(y), (uchar *)texture.Data.data() + offset + traits::BlockBytes * width * y, width, traits::Alpha);
+		offset += traits::BlockBytes * width * height;
+
+		if(!advanceProgress(width * height))
+			return false;
 	}
 
 	return true;
 }
 
 
-bool PapaFile::decodeDXT1(PapaFile::texture_t& texture)
+template<int format> bool PapaFile::decodeCompressed(const PapaFile::texture_t& texture, int mipindex, const char *data, QImage& image)
 {
-	const struct DXT1 *ptr = (const struct DXT1 *)(texture.Data.data());
-
-	for(int m = 0; m < texture.NumberMinimaps; ++m)
-	{
-		int divider = pow(2, m);
-		qint16 width = texture.Width / divider;
-		qint16 height = texture.Height / divider;
-
-		QImage image = QImage(width, height, QImage::Format_RGB32);
-		image.fill(0);
-
-		for(int j = 0; j < (width * height + 15)/ 16; j++) // The +15 is to make sure it works for 2x2 and 1x1 minimaps
-		{
-			colour_t colour2, colour3;
-			QRgb palette[4];
-			if(ptr->colour0.value > ptr->colour1.value)
-			{	// Four colours
-				
-				// Interpolate the other two colours.
-				colour2.rgb.red = (2 * ptr->colour0.rgb.red + ptr->colour1.rgb.red) / 3;
-				colour2.rgb.green = (2 * ptr->colour0.rgb.green + ptr->colour1.rgb.green) / 3;
-				colour2.rgb.blue = (2 * ptr->colour0.rgb.blue + ptr->colour1.rgb.blue) / 3;
-				colour3.rgb.red = (ptr->colour0.rgb.red + 2 * ptr->colour1.rgb.red) / 3;
-				colour3.rgb.green = (ptr->colour0.rgb.green + 2 * ptr->colour1.rgb.green) / 3;
-				colour3.rgb.blue = (ptr->colour0.rgb.blue + 2 * ptr->colour1.rgb.blue) / 3;
-
-				palette[0] = qRgb(255*ptr->colour0.rgb.red/32, 255*ptr->colour0.rgb.green/64, 255*ptr->colour0.rgb.blue/32);
-				palette[1] = qRgb(255*ptr->colour1.rgb.red/32, 255*ptr->colour1.rgb.green/64, 255*ptr->colour1.rgb.blue/32);
-				palette[2] = qRgb(255*colour2.rgb.red/32, 255*colour2.rgb.green/64, 255*colour2.rgb.blue/32);
-				palette[3] = qRgb(255*colour3.rgb.red/32, 255*colour3.rgb.green/64, 255*colour3.rgb.blue/32);
-			}
-			else
-			{	// Three colours with black
-				
-				// The remaining colour is the average of the other two colours.
-				colour2.rgb.red = (ptr->colour0.rgb.red + ptr->colour1.rgb.red) / 2;  
-				colour2.rgb.green = (ptr->colour0.rgb.green + ptr->colour1.rgb.green) / 2;  
-				colour2.rgb.blue = (ptr->colour0.rgb.blue + ptr->colour1.rgb.blue) / 2;  
-				colour3.value = 0;
-
-				palette[0] = qRgb(255*ptr->colour0.rgb.red/32, 255*ptr->colour0.rgb.green/64, 255*ptr->colour0.rgb.blue/32);
-				palette[1] = qRgb(255*ptr->colour1.rgb.red/32, 255*ptr->colour1.rgb.green/64, 255*ptr->colour1.rgb.blue/32);
-				palette[2] = qRgb(255*colour2.rgb.red/32, 255*colour2.rgb.green/64, 255*colour2.rgb.blue/32);
-				palette[3] = qRgb(0, 0, 0);
-			}
-/*
-			if(texture.sRGB)
-				convertFromSRGB(palette, 4);
-*/
-			int x0 = j % ((width+3)/4);
-			int y0 = j / ((height+3)/4);
-
-			quint32 rgbbits = ptr->rgbbits;
-			for(int y = 0; y < std::min(4, (int)height); ++y)
-			{
-				for(int x = 0; x < std::min(4, (int)width); ++x)
-				{
-					quint8 colourindex = rgbbits & 0b11;
-					image.setPixel(4*x0 + x, 4*y0 + y, qRgb(qRed(palette[colourindex]), qGreen(palette[colourindex]), qBlue(palette[colourindex])));
-					rgbbits >>= 2;
-				}
-			}
-
-			ptr++;
-		}
-		texture.Image.push_back(image);
-	}
+	typedef formattraits_t<format> traits;
 
+	image = QImage(mipSize(texture, mipindex), traits::ImageFormat);
+	decodeBlocks(traits::decoder(PapaKernels::active()), traits::BlockBytes, data, image);
 	return true;
 }
 
@@ -696,21 +887,25 @@ bool PapaFile::encodeDXT1(PapaFile::texture_t& texture)
 
 	for(int m = 0; m < texture.NumberMinimaps; ++m)
 	{
-		QImage image(texture.Image[m].convertToFormat(QImage::Format_RGB16)); // Provides dithering. Nice!
-		qint16 width = image.width();
-		qint16 height = image.height();
-
-		for(int j = 0; j < (width * height + 15)/ 16; j++) // The +15 is to make sure it works for 2x2 and 1x1 minimaps
+		// RGB16 provides dithering. Nice! Without it the colours just get
+		// truncated to 16 bits below.
+		QImage image(EncoderOptions.Dither ? texture.Image[m].convertToFormat(QImage::Format_RGB16) : texture.Image[m]);
+		int width = image.width();
+		int height = image.height();
+		int blockswide = (width + 3) / 4;
+		int blockshigh = (height + 3) / 4;
+
+		for(int j = 0; j < blockswide * blockshigh; j++)
 		{
 			QList<colour_t> colours;
 
-			int x0 = j % ((width+3)/4);
-			int y0 = j / ((height+3)/4);
+			int x0 = j % blockswide;
+			int y0 = j / blockswide;
 
 			// TODO: This can be sped up by directly accessing image.bits() and casting to colour_t.
-			for(int y = 0; y < std::min(4, (int)height); ++y)
+			for(int y = 0; y < std::min(4, height - 4*y0); ++y)
 			{
-				for(int x = 0; x < std::min(4, (int)width); ++x)
+				for(int x = 0; x < std::min(4, width - 4*x0); ++x)
 				{
 					QRgb qcolour = image.pixel(4*x0 + x, 4*y0 + y);
 					colour_t colour;
@@ -752,7 +947,7 @@ bool PapaFile::encodeDXT1(PapaFile::texture_t& texture)
 					}
 					break;
 				default:
-					findOptimalColours(colour0, colour1, colours);
+					findOptimalColours(colour0, colour1, colours, EncoderOptions.Iterations, texture.sRGB);
 			}
 
 			colour_t colour2, colour3;
@@ -787,18 +982,17 @@ bool PapaFile::encodeDXT1(PapaFile::texture_t& texture)
 				palette[2] = qRgb(255*colour2.rgb.red/32, 255*colour2.rgb.green/64, 255*colour2.rgb.blue/32);
 				palette[3] = qRgb(0, 0, 0);
 			}
-/*
-			if(texture.sRGB)
-				convertToSRGB(palette, 4);
-*/
-			quint32 rgbbits = 0;;
-			for(int y = std::min(4, (int)height) - 1; y >= 0; --y)
+			quint32 rgbbits = 0;
+			for(int y = 3; y >= 0; --y)
 			{
-				for(int x = std::min(4, (int)width) - 1; x >= 0; --x)
+				for(int x = 3; x >= 0; --x)
 				{
 					rgbbits <<= 2;
+					if(4*x0 + x >= width || 4*y0 + y >= height)
+						continue; // Outside of the image, so it doesn't matter
+
 					QRgb pixelcolour = image.pixel(4*x0 + x, 4*y0 + y);
-					quint8 colourindex = findClosestColour(pixelcolour, palette);
+					quint8 colourindex = findClosestColour(pixelcolour, palette, texture.sRGB);
 					Q_ASSERT(colourindex < 4);
 					rgbbits += colourindex;
 				}
@@ -809,6 +1003,9 @@ bool PapaFile::encodeDXT1(PapaFile::texture_t& texture)
 			ptr->rgbbits = rgbbits;
 
 			ptr++;
+
+			if(x0 == blockswide - 1 && !advanceProgress(width * std::min(4, height - 4*y0)))
+				return false;
 		}
 	}
 
@@ -816,226 +1013,371 @@ bool PapaFile::encodeDXT1(PapaFile::texture_t& texture)
 }
 
 
-bool PapaFile::decodeDXT5(PapaFile::texture_t& texture)
+void PapaFile::decodeBlocks(void (*decode)(const uchar *, int, quint32 **), int blocksize, const char *data, QImage& image)
 {
-	const struct DXT5 *ptr = (const struct DXT5 *)(texture.Data.data());
+	// A row of blocks at a time, straight into the image unless the blocks
+	// stick out on the right or the bottom. That happens for 2x2 and 1x1
+	// minimaps, or textures that are not a multiple of four.
+	int width = image.width();
+	int height = image.height();
+	int blockswide = (width + 3) / 4;
+	int blockshigh = (height + 3) / 4;
+	QVector<quint32> buffer(16 * blockswide);
+
+	for(int y0 = 0; y0 < blockshigh; y0++)
+	{
+		bool direct = (width % 4 == 0 && 4 * y0 + 4 <= height);
+		quint32 *lines[4];
+		for(int y = 0; y < 4; y++)
+			lines[y] = direct ? (quint32 *)image.scanLine(4 * y0 + y) : buffer.data() + 4 * blockswide * y;
 
-	for(int i = 0; i < texture.NumberMinimaps; i++)
+		decode((const uchar *)data + blocksize * blockswide * y0, blockswide, lines);
+
+		for(int y = 0; !direct && y < 4 && 4 * y0 + y < height; y++)
+			memcpy(image.scanLine(4 * y0 + y), lines[y], width * sizeof(quint32));
+	}
+}
+
+QImage PapaFile::halveSRGB(const QImage& image, const QSize& size)
+{
+	QImage source = image.hasAlphaChannel() ? image.convertToFormat(QImage::Format_ARGB32) : image.convertToFormat(QImage::Format_RGB32);
+	QImage half(size, source.format());
+	const PapaKernels::kernels_t& kernels = PapaKernels::active();
+	quint32 single[4];
+
+	for(int y = 0; y < size.height(); y++)
 	{
-		int divider = pow(2, i);
-		qint16 width = texture.Width / divider;
-		qint16 height = texture.Height / divider;
+		// A one pixel wide or high image is averaged with itself.
+		const quint32 *line0 = (const quint32 *)source.constScanLine(std::min(2 * y, source.height() - 1));
+		const quint32 *line1 = (const quint32 *)source.constScanLine(std::min(2 * y + 1, source.height() - 1));
+		if(source.width() == 1)
+		{
+			single[0] = single[1] = line0[0];
+			single[2] = single[3] = line1[0];
+			line0 = single;
+			line1 = single + 2;
+		}
+		kernels.halveSRGB(line0, line1, (quint32 *)half.scanLine(y), size.width());
+	}
+
+	return half;
+}
 
-		QImage image = QImage(width, height, QImage::Format_ARGB32);
-		image.fill(qRgb(255, 0, 0));
+// The pixels of an image as 0xAARRGGBB scanlines, without converting the
+// formats that already are. Premultiplied stays premultiplied, like
+// QImage::pixel returns it.
+QImage PapaFile::rgbImage(const QImage& image)
+{
+	if(image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied)
+		return image;
+	return image.convertToFormat(QImage::Format_ARGB32);
+}
+
+bool PapaFile::inspect(const QString& filename, PapaFile::info_t& info, QString& error)
+{
+	// Like load, but only reads the headers and accepts any texture format.
+	QFile file(filename);
+	if(!file.open(QIODevice::ReadOnly))
+	{
+		error = file.errorString();
+		return false;
+	}
+
+	Header papaheader;
+	if(file.read((char *)&papaheader, sizeof(Header)) != sizeof(Header) || QByteArray(papaheader.Identification, 4) != "apaP")
+	{
+		error = "Not a PAPA file";
+		return false;
+	}
 
-		for(int j = 0; j < texture.Width * texture.Height / (16 * divider * divider); j++)
+	info.HeaderUnknowns[0] = papaheader.Unknown1[0];
+	info.HeaderUnknowns[1] = papaheader.Unknown1[1];
+	for(int i = 0; i < 4; i++)
+		info.HeaderUnknowns[i + 2] = papaheader.Unknown2[i];
+
+	static const char *sections[] = {"bones", "textures", "vertices", "indices", "materials", "meshes", "skeletons", "models", "animations"};
+	const qint64 offsets[] = {
+		papaheader.OffsetBonesHeader,
+		papaheader.OffsetTextureInformation,
+		papaheader.OffsetVerticesInformation,
+		papaheader.OffsetIndicesInformation,
+		papaheader.OffsetMaterialInformation,
+		papaheader.OffsetMeshInformation,
+		papaheader.OffsetSkeletonInformation,
+		papaheader.OffsetModelInformation,
+		papaheader.OffsetAnimationInformation
+	};
+	info.Sections.clear();
+	for(int i = 0; i < 9; i++)
+	{
+		if(offsets[i] >= 0)
+			info.Sections.append(sections[i]);
+	}
+
+	info.Bones.clear();
+	if(papaheader.OffsetBonesHeader >= 0 && file.seek(papaheader.OffsetBonesHeader))
+	{
+		QList<BonesHeader> boneheaders;
+		for(int i = 0; i < papaheader.NumberOfBones; i++)
 		{
-			// Calculate the eigth alpha values in use.
-			quint8 alphapalette[8];
-			alphapalette[0] = ptr->alpha0;
-			alphapalette[1] = ptr->alpha1;
-			if(ptr->alpha0 > ptr->alpha1)
+			BonesHeader boneheader;
+			if(file.read((char *)&boneheader, sizeof(BonesHeader)) != sizeof(BonesHeader))
 			{
-				for(int k = 0; k < 6; k++)
-					alphapalette[k+2] = ((6. - k) * ptr->alpha0 + (k + 1.) * ptr->alpha1) / 7.;
+				error = "Failed to read BonesHeader";
+				return false;
 			}
-			else
+			boneheaders.append(boneheader);
+		}
+		for(QList<BonesHeader>::const_iterator boneheader = boneheaders.constBegin(); boneheader != boneheaders.constEnd(); ++boneheader)
+		{
+			if(boneheader->LengthOfBoneName < 0 || boneheader->LengthOfBoneName > 4096 || !file.seek(boneheader->OffsetBoneName))
 			{
-				for(int k = 0; k < 4; k++)
-					alphapalette[k+2] = ((4. - k) * ptr->alpha0 + (k + 1.) * ptr->alpha1) / 5.;
-				alphapalette[6] = 0;
-				alphapalette[7] = 255;
+				error = "Failed to read bone name";
+				return false;
 			}
+			info.Bones.append(QString::fromAscii(file.read(boneheader->LengthOfBoneName)));
+		}
+	}
 
-			// Get the alpha value for each pixel.
-			quint8 alphatexel[4][4];
-			quint64 alphabits = 0;
-			quint8 fakebits[8] = {0,0,0,0,0,0,0,0};
-			for(int k = 0; k < 6; k++)
+	info.Textures.clear();
+	if(papaheader.OffsetTextureInformation >= 0 && file.seek(papaheader.OffsetTextureInformation))
+	{
+		for(int i = 0; i < papaheader.NumberOfTextures; i++)
+		{
+			TextureInformationHeader header;
+			if(file.read((char *)&header, sizeof(TextureInformationHeader)) != sizeof(TextureInformationHeader))
 			{
-				fakebits[k] = ptr->alphabits[k];
+				error = QString("Failed to read TextureInformationHeader for texture %1").arg(i);
+				return false;
 			}
-			alphabits = *((quint64 *)&fakebits);
 
-			for(int y = 0; y < 4; ++y)
+			textureinfo_t texture;
+			texture.Format = header.TextureFormat;
+			texture.Width = header.Width;
+			texture.Height = header.Height;
+			texture.Mipmaps = header.NumberMinimaps;
+			texture.SRGB = (header.SRGB == 1);
+			texture.Unknown1[0] = header.Unknown1[0];
+			texture.Unknown1[1] = header.Unknown1[1];
+			texture.Unknown2 = header.Unknown2;
+			texture.Unknown3 = header.Unknown3;
+			texture.Length = header.Length;
+			info.Textures.append(texture);
+
+			// Skip the data to get to the next header.
+			if(!file.seek(file.pos() + header.Length))
 			{
-				for(int x = 0; x < 4; ++x)
-				{
-					alphatexel[x][y] = alphapalette[alphabits & 0b111];
-					alphabits >>= 3;
-				}
-			}
-
-			QRgb palette[4];
-			colour_t colour2, colour3;
-			colour2.rgb.red = (2 * ptr->colour0.rgb.red + ptr->colour1.rgb.red) / 3;
-			colour2.rgb.green = (2 * ptr->colour0.rgb.green + ptr->colour1.rgb.green) / 3;
-			colour2.rgb.blue = (2 * ptr->colour0.rgb.blue + ptr->colour1.rgb.blue) / 3;
-			colour3.rgb.red = (ptr->colour0.rgb.red + 2 * ptr->colour1.rgb.red) / 3;
-			colour3.rgb.green = (ptr->colour0.rgb.green + 2 * ptr->colour1.rgb.green) / 3;
-			colour3.rgb.blue = (ptr->colour0.rgb.blue + 2 * ptr->colour1.rgb.blue) / 3;
-
-			palette[0] = qRgb(255*ptr->colour0.rgb.red/32, 255*ptr->colour0.rgb.green/64, 255*ptr->colour0.rgb.blue/32);
-			palette[1] = qRgb(255*ptr->colour1.rgb.red/32, 255*ptr->colour1.rgb.green/64, 255*ptr->colour1.rgb.blue/32);
-			palette[2] = qRgb(255*colour2.rgb.red/32, 255*colour2.rgb.green/64, 255*colour2.rgb.blue/32);
-			palette[3] = qRgb(255*colour3.rgb.red/32, 255*colour3.rgb.green/64, 255*colour3.rgb.blue/32);
-
-			if(texture.sRGB)
-				convertFromSRGB(palette, 4);
-
-			int x0;
-			if(texture.Width/(4*divider) > 0)
-				x0 = j % (texture.Width/(4*divider));
-			else
-				x0 = j;
-
-			int y0;
-			if(texture.Height/(4*divider) > 0)
-				y0 = j / (texture.Height/(4*divider));
-			else
-				y0 = j;
-
-			quint32 rgbbits = ptr->rgbbits;
-			for(int y = 0; y < 4; ++y)
-			{
-				for(int x = 0; x < 4; ++x)
-				{
-					quint8 colourindex = rgbbits & 0b11;
-					image.setPixel(4*x0 + x, 4*y0 + y, qRgba(qRed(palette[colourindex]), qGreen(palette[colourindex]), qBlue(palette[colourindex]), alphatexel[x][y]));
-					rgbbits >>= 2;
-				}
+				error = QString("Failed to skip texture data for texture %1").arg(i);
+				return false;
 			}
-
-			ptr++;
 		}
-		texture.Image.push_back(image);
 	}
 
 	return true;
 }
 
-bool PapaFile::encodeDXT5(PapaFile::texture_t& /*texture*/)
+QString PapaFile::formatName(int format)
 {
-	return false;
+	static const char *names[] = {
+		"Invalid", "A8R8G8B8", "X8R8G8B8", "A8B8G8R8", "DXT1", "DXT3", "DXT5",
+		"R32F", "RG32F", "RGBA32F", "R16F", "RG16F", "RGBA16F", "R8G8",
+		"D0", "D16", "D24", "D24S8", "D32",
+		"R8I", "R8UI", "R16I", "R16UI", "RG8I", "RG8UI", "RG16I", "RG16UI", "R32I", "R32UI",
+		"Shadow16", "Shadow24", "Shadow32"
+	};
+
+	if(format >= 0 && format < (int)(sizeof(names) / sizeof(names[0])))
+		return names[format];
+	else
+		return QString("Unknown%1").arg(format);
 }
 
+bool PapaFile::isSRGB(int textureindex)
+{
+	return textureindex < Headers.count() && Headers.at(textureindex).sRGB;
+}
+
+bool PapaFile::canEncode()
+{
+	const codec_t *formatcodec = Headers.count() > 0 ? codec(Headers.at(0).Format) : NULL;
+	return formatcodec && formatcodec->Encode;
+}
 
 QString PapaFile::format()
 {
-	if(Textures.length() > 0)
+	if(Headers.count() > 0)
 	{
-		switch(Textures[0].Format)
-		{
-			case texture_t::X8R8G8B8:
-				return "X8R8G8B8";
-			case texture_t::A8R8G8B8:
-				return "A8R8G8B8";
-			case texture_t::DXT1:
-				return "DXT1";
-			case texture_t::DXT5:
-				return "DXT5";
-			default:
-				return "Unsupported";
-		}
+		const codec_t *formatcodec = codec(Headers.at(0).Format);
+		return formatcodec ? formatcodec->Name : "Unsupported";
 	}
 
 	return "None";
 }
 
-void PapaFile::convertFromSRGB(QRgb* palette, int size)
+const QImage *PapaFile::image(int textureindex, int mipindex)
 {
-/*
-	// From https://en.wikipedia.org/w/index.php?title=SRGB&oldid=586514424#The_reverse_transformation
-	for(int i = 0; i < size; i++)
+	QMutexLocker locker(&Mutex);
+
+	if(textureindex < Textures.count())
 	{
-		float red = qRed(palette[i]) / 255.;
-		if(red <= 0.04045)
-			red /= 12.92;
+		if(mipindex < Textures[textureindex].Image.count())
+			Stats.add(Textures[textureindex].Image[mipindex].isNull() ? PapaStats::CacheMisses : PapaStats::CacheHits);
+		if(mipindex < Textures[textureindex].Image.count() && decode(textureindex, mipindex))
+		{
+			return &Textures[textureindex].Image[mipindex];
+		}
 		else
-			red = pow((red + 0.055) / (1.055), 2.4);
+			return NULL;
+	}
+	else
+		return NULL;
+}
 
-		float green = qGreen(palette[i]) / 255.;
-		if(green <= 0.04045)
-			green /= 12.92;
-		else
-			green = pow((green + 0.055) / (1.055), 2.4);
+QImage PapaFile::mipmap(int textureindex, int mipindex, bool keep)
+{
+	QMutexLocker locker(&Mutex);
 
-		float blue = qBlue(palette[i]) / 255.;
-		if(blue <= 0.04045)
-			blue /= 12.92;
-		else
-			blue = pow((blue + 0.055) / (1.055), 2.4);
+	if(textureindex >= Textures.count() || mipindex >= Textures[textureindex].Image.count())
+		return QImage();
 
-		palette[i] = qRgb(
-			255*(0.4124*red + 0.3576*green + 0.1805*blue),
-			255*(0.2126*red + 0.7152*green + 0.0722*blue),
-			255*(0.0193*red + 0.1192*green + 0.9502*blue)
-		);
+	Stats.add(Textures[textureindex].Image[mipindex].isNull() ? PapaStats::CacheMisses : PapaStats::CacheHits);
+	if(keep)
+	{
+		if(!decode(textureindex, mipindex))
+			return QImage();
+		return Textures[textureindex].Image[mipindex];
 	}
-	*/
+
+	if(!Textures[textureindex].Image[mipindex].isNull())
+		return Textures[textureindex].Image[mipindex];
+
+	// Decode without keeping the result, so going through lots of textures
+	// doesn't fill up the memory.
+	QByteArray data;
+	QImage image;
+	if(!readMipmap(textureindex, mipindex, data) || !decodeMipmap(textureindex, mipindex, data.constData(), image))
+		return QImage();
+
+	return image;
 }
 
-void PapaFile::convertToSRGB(QRgb* palette, int size)
-{/*
-	// From https://en.wikipedia.org/w/index.php?title=SRGB&oldid=586514424#The_forward_transformation_.28CIE_xyY_or_CIE_XYZ_to_sRGB.29
-	for(int i = 0; i < size; i++)
+QImage PapaFile::tryMipmap(int textureindex, int mipindex)
+{
+	// Like mipmap with keep, but a null image instead of waiting for a job
+	// that is busy with this file, for callers on the GUI thread.
+	if(!Mutex.tryLock())
+		return QImage();
+
+	QImage image;
+	if(textureindex < Textures.count() && mipindex < Textures[textureindex].Image.count())
 	{
-		float red = qRed(palette[i]) / 255.;
-		float green = qGreen(palette[i]) / 255.;
-		float blue = qBlue(palette[i]) / 255.;
-		
-		float newred = 
-
-		palette[i] = qRgb(
-			255*(0.4124*red + 0.3576*green + 0.1805*blue),
-			255*(0.2126*red + 0.7152*green + 0.0722*blue),
-			255*(0.0193*red + 0.1192*green + 0.9502*blue)
-		);
-	}*/
+		Stats.add(Textures[textureindex].Image[mipindex].isNull() ? PapaStats::CacheMisses : PapaStats::CacheHits);
+		if(decode(textureindex, mipindex))
+			image = Textures[textureindex].Image[mipindex];
+	}
+
+	Mutex.unlock();
+	return image;
 }
 
+int PapaFile::mipmapFor(int textureindex, const QSize& minimumsize)
+{
+	// The smallest mipmap that still covers the requested size.
+	int mipindex = 0;
+	while(mipindex + 1 < mipCount(textureindex))
+	{
+		QSize next = size(textureindex, mipindex + 1);
+		if(next.width() < minimumsize.width() && next.height() < minimumsize.height())
+			break;
+		mipindex++;
+	}
 
-const QImage *PapaFile::image(int textureindex, int mipindex)
+	return mipindex;
+}
+
+bool PapaFile::preload()
 {
-	if(textureindex < Textures.count())
+	// Reads all the texture data in one go, decoding can then be done
+	// without touching the disk.
+	QMutexLocker locker(&Mutex);
+	for(int i = 0; i < Textures.count(); i++)
 	{
-		if(mipindex < Textures[textureindex].Image.count())
+		if(!readData(i))
+			return false;
+	}
+
+	return true;
+}
+
+bool PapaFile::release()
+{
+	// Drops the decoded mipmaps and the texture data, they are read from the
+	// file again when needed. Skipped when busy rather than blocking the
+	// caller, which then has to try again later.
+	if(!Mutex.tryLock())
+		return false;
+
+	if(!Modified)
+	{
+		for(QList<texture_t>::iterator tex = Textures.begin(); tex != Textures.end(); ++tex)
 		{
-			return &Textures[textureindex].Image[mipindex];
+			tex->Data.clear();
+			for(int m = 0; m < tex->Image.count(); m++)
+				tex->Image[m] = QImage();
 		}
-		else
-			return NULL;
 	}
+
+	Mutex.unlock();
+	return true;
+}
+
+QSize PapaFile::size(int textureindex, int mipindex)
+{
+	if(textureindex < Headers.count())
+		return mipSize(Headers.at(textureindex), mipindex);
 	else
-		return NULL;
+		return QSize();
 }
 
 bool PapaFile::importImage(const QImage &newimage, const int textureindex)
 {
+	QMutexLocker locker(&Mutex);
+
 	if(textureindex < Textures.count())
 	{
-		if(Textures[textureindex].Image.count() == 0)
-			return false;
-
-		if(newimage.size() != Textures[textureindex].Image[0].size())
+		// Everything gets replaced, so there's no need to decode the old one.
+		if(Textures[textureindex].Image.count() == 0 || newimage.size() != mipSize(Textures[textureindex], 0))
+		{
+			LastError = "The image doesn't have the same size as the texture.";
 			return false;
+		}
 
-		Textures[textureindex].Image.clear();
-		Textures[textureindex].Image.push_back(newimage);
+		// Only replace the mipmaps once they're all done, so cancelling leaves
+		// the texture as it was.
+		QList<QImage> images;
+		images.append(newimage);
+		startProgress(Textures[textureindex].NumberMinimaps);
 		for(int m = 1; m < Textures[textureindex].NumberMinimaps; m++)
 		{
-			int divider = pow(2, m);
-			qint16 width = Textures[textureindex].Width / divider;
-			qint16 height = Textures[textureindex].Height / divider;
-
-			Textures[textureindex].Image.push_back(newimage.scaled(width, height));
+			// sRGB ones are halved one at a time in linear light, otherwise
+			// they'd get darker with every mipmap.
+			if(Textures[textureindex].sRGB)
+				images.append(halveSRGB(images.last(), mipSize(Textures[textureindex], m)));
+			else
+				images.append(newimage.scaled(mipSize(Textures[textureindex], m)));
+			if(!advanceProgress(1))
+			{
+				LastError = "Cancelled.";
+				return false;
+			}
 		}
+		advanceProgress(1);
+		Textures[textureindex].Image = images;
 	}
 	else
 		return false;
 
-	Modified = true;
+	Modified = 1;
 	return true;
 }
 
@@ -22,6 +22,10 @@
 
 #include <QObject>
 #include <QImage>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QStringList>
+#include "papastats.h"
 
 class PapaFile : public QObject
 {
@@ -35,17 +39,72 @@ public:
 //	PapaFile& operator=(const PapaFile& other);
 	bool load(QString filename);
 	bool save(QString filename = "");
+	bool write(const QString& filename);
+	bool encode(QByteArray& contents);
+	bool store(const QString& filename, const QByteArray& contents);
+	bool preload();
+	void markSaved(const QString& filename);
+	void cancel(bool cancelled = true) {Cancelled = cancelled ? 1 : 0;}
 	bool isValid() {return Valid;}
 	QString lastError() {return LastError;}
-	QByteArray texture() {return Textures[0].Data;}
-	int textureCount() {return Textures.count(); }
+	QByteArray texture() {QMutexLocker locker(&Mutex); readData(0); return Textures[0].Data;}
+	int textureCount() {return Headers.count(); }
 	const QImage *image(int textureindex, int mipindex = 0);
+	QImage mipmap(int textureindex, int mipindex, bool keep = false);
+	QImage tryMipmap(int textureindex, int mipindex);
+	int mipCount(int textureindex) {return textureindex < Headers.count() ? Headers.at(textureindex).NumberMinimaps : 0;}
+	int mipmapFor(int textureindex, const QSize& minimumsize);
+	bool release();
 	QString format();
-	QSize size(int textureindex) {if(textureindex < Textures.count()) return QSize(Textures[textureindex].Width, Textures[textureindex].Height); else return QSize();}
-	QString name() {return Bones[0].name;}
+	QSize size(int textureindex, int mipindex = 0);
+	bool isSRGB(int textureindex);
+	QString name() {return Bones.isEmpty() ? QString() : Bones[0].name;}
 	bool importImage(const QImage& newimage, const int textureindex);
-	bool isModified() {return Modified;}
-	bool canEncode() {return Textures.count() > 0 ? (Textures[0].Format == texture_t::A8R8G8B8 || Textures[0].Format == texture_t::X8R8G8B8 || Textures[0].Format == texture_t::DXT1) : false;}
+	bool isModified() {return Modified != 0;}
+	QString filename() {return Filename;}
+	PapaStats::values_t stats() {return Stats.values();}
+	bool canEncode();
+
+	// Everything in the headers, for inventories. See inspect.
+	struct textureinfo_t
+	{
+		int Format;
+		int Width;
+		int Height;
+		int Mipmaps;
+		bool SRGB;
+		int Unknown1[2];
+		int Unknown2;
+		qint64 Unknown3;
+		qint64 Length;
+	};
+	struct info_t
+	{
+		QStringList Bones;
+		QStringList Sections;
+		int HeaderUnknowns[6];
+		QList<textureinfo_t> Textures;
+	};
+	static bool inspect(const QString& filename, info_t& info, QString& error);
+	static QString formatName(int format);
+
+	// Goes up whenever an encoder starts writing something different for the
+	// same image, so incremental builds know to redo their textures.
+	static const int EncoderVersion = 2;
+
+	// How the DXT1 encoder trades speed for quality. The defaults are what
+	// it has always done.
+	struct encoderoptions_t
+	{
+		bool Dither; // Dither to 16 bits before picking endpoints and indices
+		int Iterations; // Random tries at improving on the extreme colours
+	};
+	static encoderoptions_t defaultEncoderOptions();
+	void setEncoderOptions(const encoderoptions_t& options) {EncoderOptions = options;}
+	encoderoptions_t encoderOptions() {return EncoderOptions;}
+
+signals:
+	void progress(int value, int maximum);
 
 private:
 	// File format
@@ -99,7 +158,7 @@ private:
 	
 	struct texture_t
 	{
-		enum
+		enum format_t
 		{ // This comes from inside the papadump binary at position 0x0055E0DE
 			Invalid = 0,
 			A8R8G8B8,
@@ -137,8 +196,10 @@ private:
 		qint16 Width, Height;
 		int NumberMinimaps;
 		bool sRGB;
+		qint64 DataOffset;
+		qint64 DataLength;
 		QByteArray Data;
-		QList<QImage> Image;
+		QList<QImage> Image; // One per mipmap, null until it is decoded
 		struct
 		{
 			char Unknown1[2];
@@ -176,26 +237,67 @@ private:
 	};
 
 	void init();
-	bool decodeA8R8G8B8(PapaFile::texture_t& texture);
-	bool decodeX8R8G8B8(PapaFile::texture_t& texture);
-	bool decodeDXT1(PapaFile::texture_t& texture);
-	bool decodeDXT5(PapaFile::texture_t& texture);
-	bool encodeA8R8G8B8(PapaFile::texture_t& texture);
-	bool encodeX8R8G8B8(PapaFile::texture_t& texture);
+	void startProgress(qint64 total);
+	bool advanceProgress(qint64 amount);
+	static QSize mipSize(const PapaFile::texture_t& texture, int mipindex);
+	static qint64 mipLength(const PapaFile::texture_t& texture, int mipindex);
+	static qint64 mipOffset(const PapaFile::texture_t& texture, int mipindex);
+	bool readData(int textureindex);
+	bool readMipmap(int textureindex, int mipindex, QByteArray& data);
+	bool decode(int textureindex);
+	bool decode(int textureindex, int mipindex);
+	bool decodeMipmap(int textureindex, int mipindex, const char *data, QImage& image);
+
+	// What the codec knows about a format at compile time, specialised in
+	// papafile.cpp, so every decoder and encoder below is built for fixed
+	// strides and channel orders.
+	template<int format> struct formattraits_t;
+
+	// The registry of the formats the codec can read, see codec().
+	struct codec_t
+	{
+		int Format;
+		const char *Name;
+		int BlockSize; // Texels along each side of a block, 1 if uncompressed
+		int BlockBytes;
+		bool (PapaFile::*Decode)(const PapaFile::texture_t& texture, int mipindex, const char *data, QImage& image);
+		bool (PapaFile::*Encode)(PapaFile::texture_t& texture); // NULL if it can't be written
+	};
+	static const codec_t *codec(int format);
+
+	template<int format> bool decodeUncompressed(const PapaFile::texture_t& texture, int mipindex, const char *data, QImage& image);
+	template<int format> bool decodeCompressed(const PapaFile::texture_t& texture, int mipindex, const char *data, QImage& image);
+	static void decodeBlocks(void (*decode)(const uchar *, int, quint32 **), int blocksize, const char *data, QImage& image);
+	static QImage rgbImage(const QImage& image);
+	template<int format> bool encodeUncompressed(PapaFile::texture_t& texture);
 	bool encodeDXT1(PapaFile::texture_t& texture);
-	bool encodeDXT5(PapaFile::texture_t& texture);
-	void convertFromSRGB(QRgb* palette, int size);
-    void convertToSRGB(QRgb* palette, int size);
-    void findOptimalColours(PapaFile::colour_t& colour0, PapaFile::colour_t& colour1, const QList<PapaFile::colour_t>& colours);
-    float calculateChi2_four(PapaFile::colour_t col1, PapaFile::colour_t col2, const QList< PapaFile::colour_t >& colours);
-    quint8 findClosestColour(QRgb pixelcolour, QRgb* palette);
+	static QImage halveSRGB(const QImage& image, const QSize& size);
+	static void colourChannels(PapaFile::colour_t colour, bool srgb, float& red, float& green, float& blue);
+    void findOptimalColours(PapaFile::colour_t& colour0, PapaFile::colour_t& colour1, const QList<PapaFile::colour_t>& colours, int iterations, bool srgb);
+    float calculateChi2_four(PapaFile::colour_t col1, PapaFile::colour_t col2, const QList< PapaFile::colour_t >& colours, bool srgb);
+    quint8 findClosestColour(QRgb pixelcolour, QRgb* palette, bool srgb);
 
 	bool Valid;
-	bool Modified;
+	// Set by the workers that import and encode and read by the GUI thread
+	// without the lock, hence atomic.
+	QAtomicInt Modified;
 	QString LastError;
 	QList<bone_t> Bones;
 	QList<texture_t> Textures;
+	// The same textures as load found them, without data or images. Never
+	// changed afterwards, so the accessors for the header fields can read
+	// them without waiting for the lock a save holds.
+	QList<texture_t> Headers;
 	QString Filename;
+	QString WrittenFilename;
+	QList<qint64> EncodedOffsets;
+	QMutex Mutex;
+	QAtomicInt Cancelled;
+	qint64 ProgressDone;
+	qint64 ProgressTotal;
+	int ProgressReported;
+	encoderoptions_t EncoderOptions;
+	PapaStats Stats;
 	struct
 	{
 		qint16 Unknown1[2];
@@ -0,0 +1,355 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "papagenerator.h"
+#include <QFile>
+#include <QDataStream>
+#include <QDir>
+#include "papafile.h"
+#include <algorithm>
+
+// Small and the same everywhere, unlike qrand.
+static quint32 nextRandom(quint32& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static quint32 startRandom(quint32 seed)
+{
+	return seed * 2654435761u + 1;
+}
+
+static double randomFraction(quint32& state)
+{
+	return nextRandom(state) / 4294967296.;
+}
+
+static int pickWeighted(const QList<QPair<int, double> >& weights, quint32& state)
+{
+	double total = 0;
+	for(int i = 0; i < weights.count(); i++)
+		total += weights[i].second;
+
+	double pick = randomFraction(state) * total;
+	for(int i = 0; i < weights.count(); i++)
+	{
+		pick -= weights[i].second;
+		if(pick < 0)
+			return weights[i].first;
+	}
+
+	return weights.last().first;
+}
+
+int PapaGenerator::fullMipChain(int width, int height)
+{
+	// The header has four bits for it.
+	int mipmaps = 1;
+	while(std::max(width, height) >> mipmaps > 0 && mipmaps < 15)
+		mipmaps++;
+
+	return mipmaps;
+}
+
+qint64 PapaGenerator::mipLength(int format, int width, int height)
+{
+	// Bytes per 4x4 block for the compressed formats, per texel for the rest,
+	// indexed like PapaFile's texture_t formats.
+	static const int blockbytes[] = {0, 0, 0, 0, 8, 16, 16};
+	static const int texelbytes[] = {
+		0, 4, 4, 4, 0, 0, 0,
+		4, 8, 16, 2, 4, 8, 2,
+		0, 2, 4, 4, 4,
+		1, 1, 2, 2, 2, 2, 4, 4, 4, 4,
+		2, 4, 4
+	};
+
+	if(format >= 4 && format <= 6)
+		return (qint64)blockbytes[format] * ((width + 3) / 4) * ((height + 3) / 4);
+	if(format > 0 && format < (int)(sizeof(texelbytes) / sizeof(texelbytes[0])))
+		return (qint64)texelbytes[format] * width * height;
+
+	return 0;
+}
+
+QImage PapaGenerator::image(int width, int height, quint32 seed)
+{
+	// Gradients, a few hard edged shapes and some noise, which is roughly
+	// what makes real textures hard or easy to compress.
+	quint32 random = startRandom(seed);
+	QImage image(width, height, QImage::Format_ARGB32);
+	int shapes = 3 + nextRandom(random) % 5;
+	QList<QRgb> colours;
+	QList<int> centres;
+	for(int i = 0; i < shapes; i++)
+	{
+		colours.append(qRgba(nextRandom(random) % 256, nextRandom(random) % 256, nextRandom(random) % 256, 128 + nextRandom(random) % 128));
+		centres.append(nextRandom(random) % std::max(1, width));
+		centres.append(nextRandom(random) % std::max(1, height));
+		centres.append(1 + nextRandom(random) % std::max(1, std::min(width, height) / 3));
+	}
+
+	for(int y = 0; y < height; y++)
+	{
+		QRgb *line = (QRgb *)image.scanLine(y);
+		for(int x = 0; x < width; x++)
+		{
+			int red = 255 * x / std::max(1, width - 1);
+			int green = 255 * y / std::max(1, height - 1);
+			int blue = (red + green) / 2;
+			int alpha = 255;
+			for(int i = 0; i < shapes; i++)
+			{
+				int dx = x - centres[3 * i];
+				int dy = y - centres[3 * i + 1];
+				int radius = centres[3 * i + 2];
+				if(dx * dx + dy * dy < radius * radius)
+				{
+					red = qRed(colours[i]);
+					green = qGreen(colours[i]);
+					blue = qBlue(colours[i]);
+					alpha = qAlpha(colours[i]);
+				}
+			}
+			int noise = (int)(nextRandom(random) % 17) - 8;
+			line[x] = qRgba(qBound(0, red + noise, 255), qBound(0, green + noise, 255), qBound(0, blue + noise, 255), alpha);
+		}
+	}
+
+	return image;
+}
+
+QByteArray PapaGenerator::textureData(const texturespec_t& texture, quint32 seed)
+{
+	int mipmaps = texture.Mipmaps > 0 ? texture.Mipmaps : fullMipChain(texture.Width, texture.Height);
+	QByteArray data;
+	QImage full;
+	quint32 random = startRandom(seed);
+	for(int m = 0; m < mipmaps; m++)
+	{
+		int width = std::max(1, texture.Width >> m);
+		int height = std::max(1, texture.Height >> m);
+		qint64 length = mipLength(texture.Format, width, height);
+
+		if(texture.Format >= 1 && texture.Format <= 3)
+		{
+			// Real pixels for the uncompressed formats, as R, G, B, A bytes.
+			if(full.isNull())
+				full = image(texture.Width, texture.Height, seed);
+			QImage mip = (m == 0) ? full : full.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			int start = data.length();
+			data.resize(start + length);
+			uchar *pixel = (uchar *)data.data() + start;
+			for(int y = 0; y < height; y++)
+			{
+				const QRgb *line = (const QRgb *)mip.constScanLine(y);
+				for(int x = 0; x < width; x++, pixel += 4)
+				{
+					pixel[0] = qRed(line[x]);
+					pixel[1] = qGreen(line[x]);
+					pixel[2] = qBlue(line[x]);
+					pixel[3] = qAlpha(line[x]);
+				}
+			}
+		}
+		else
+		{
+			// Anything goes for blocks and the formats that can't be decoded.
+			int start = data.length();
+			data.resize(start + length);
+			uchar *byte = (uchar *)data.data() + start;
+			for(qint64 i = 0; i < length; i++)
+				byte[i] = nextRandom(random) & 0xff;
+		}
+	}
+
+	return data;
+}
+
+bool PapaGenerator::write(const QString& filename, const QList<texturespec_t>& textures, const QStringList& bones, quint32 seed, QString& error, bool sections)
+{
+	// The same layout PapaFile writes: header, the textures each followed by
+	// their data, then the bones and their names. The other sections are
+	// never looked into, so they are just noise after the bone names.
+	QByteArray contents;
+	QDataStream stream(&contents, QIODevice::WriteOnly);
+	stream.setByteOrder(QDataStream::LittleEndian);
+
+	const qint64 headersize = 104;
+	const qint64 textureheadersize = 24;
+	const qint64 boneheadersize = 16;
+
+	QList<QByteArray> data;
+	qint64 bonesoffset = headersize;
+	for(int i = 0; i < textures.count(); i++)
+	{
+		data.append(textureData(textures[i], seed + i));
+		bonesoffset += textureheadersize + data.last().length();
+	}
+
+	// Vertices, indices, materials and meshes, one each.
+	quint32 random = startRandom(seed);
+	QList<QByteArray> extra;
+	qint64 extraoffset = bonesoffset + bones.count() * boneheadersize;
+	for(int i = 0; i < bones.count(); i++)
+		extraoffset += bones[i].length();
+	for(int i = 0; sections && i < 4; i++)
+	{
+		QByteArray section(64 + nextRandom(random) % 4096, 0);
+		for(int j = 0; j < section.length(); j++)
+			section[j] = nextRandom(random) & 0xff;
+		extra.append(section);
+	}
+
+	stream.writeRawData("apaP", 4);
+	stream << (qint16)0 << (qint16)0;
+	stream << (qint16)bones.count() << (qint16)textures.count();
+	for(int i = 0; i < 6; i++)
+		stream << (qint16)(i < extra.count() ? 1 : 0); // Vertex and index buffers, materials, meshes, skeletons and models
+	for(int i = 0; i < 4; i++)
+		stream << (qint16)0;
+	stream << (qint64)(bones.isEmpty() ? -1 : bonesoffset);
+	stream << (qint64)(textures.isEmpty() ? -1 : headersize);
+	for(int i = 0; i < 7; i++)
+	{
+		stream << (qint64)(i < extra.count() ? extraoffset : -1);
+		if(i < extra.count())
+			extraoffset += extra[i].length();
+	}
+
+	for(int i = 0; i < textures.count(); i++)
+	{
+		const texturespec_t& texture = textures[i];
+		int mipmaps = texture.Mipmaps > 0 ? texture.Mipmaps : fullMipChain(texture.Width, texture.Height);
+		stream << (quint8)0 << (quint8)0 << (quint8)texture.Format;
+		stream << (quint8)((mipmaps & 0x0f) | (texture.SRGB ? 0x80 : 0));
+		stream << (qint16)texture.Width << (qint16)texture.Height;
+		stream << (qint64)data[i].length() << (qint64)128;
+		stream.writeRawData(data[i].constData(), data[i].length());
+	}
+
+	qint64 nameoffset = bonesoffset + bones.count() * boneheadersize;
+	for(int i = 0; i < bones.count(); i++)
+	{
+		stream << (qint64)bones[i].length() << nameoffset;
+		nameoffset += bones[i].length();
+	}
+	for(int i = 0; i < bones.count(); i++)
+		stream.writeRawData(bones[i].toAscii().constData(), bones[i].length());
+	for(int i = 0; i < extra.count(); i++)
+		stream.writeRawData(extra[i].constData(), extra[i].length());
+
+	QFile file(filename);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(contents) != contents.length())
+	{
+		error = file.errorString();
+		return false;
+	}
+
+	return true;
+}
+
+PapaGenerator::corpusspec_t PapaGenerator::defaultCorpus()
+{
+	// Roughly what the game ships with: mostly compressed, mostly between
+	// 256 and 1024, with the odd tiny and huge one.
+	corpusspec_t corpus;
+	corpus.Count = 1000;
+	parseWeights("DXT1:50,DXT5:30,A8R8G8B8:15,X8R8G8B8:5", true, corpus.Formats);
+	parseWeights("1:1,16:3,64:10,256:30,512:25,1024:20,2048:8,4096:2.5,8192:0.5", false, corpus.Sizes);
+	corpus.NonSquare = 0.2;
+	corpus.MaxBones = 32;
+	corpus.Sections = 0.1;
+	corpus.Seed = 1;
+	return corpus;
+}
+
+bool PapaGenerator::parseWeights(const QString& text, bool formats, QList<QPair<int, double> >& weights)
+{
+	// "value:weight,value:weight,...", the weight defaults to 1. The values
+	// are format names or edge lengths.
+	weights.clear();
+	QStringList items = text.split(',', QString::SkipEmptyParts);
+	for(QStringList::const_iterator item = items.constBegin(); item != items.constEnd(); ++item)
+	{
+		QStringList parts = item->split(':');
+		bool ok = true;
+		double weight = parts.count() > 1 ? parts[1].toDouble(&ok) : 1;
+		if(!ok || weight < 0 || parts.count() > 2)
+			return false;
+
+		int value = 0;
+		if(formats)
+		{
+			while(value < 64 && PapaFile::formatName(value) != parts[0])
+				value++;
+			ok = (value > 0 && value < 64);
+		}
+		else
+		{
+			value = parts[0].toInt(&ok);
+			ok = ok && value >= 1 && value <= 16384;
+		}
+		if(!ok)
+			return false;
+
+		weights.append(qMakePair(value, weight));
+	}
+
+	return !weights.isEmpty();
+}
+
+bool PapaGenerator::writeCorpus(const QString& destination, const corpusspec_t& corpus, QStringList& filenames, QString& error)
+{
+	// A hundred files per directory, like a unit or a planet biome.
+	quint32 random = startRandom(corpus.Seed);
+	QDir root(destination);
+	for(int i = 0; i < corpus.Count; i++)
+	{
+		texturespec_t texture;
+		texture.Format = pickWeighted(corpus.Formats, random);
+		texture.Width = pickWeighted(corpus.Sizes, random);
+		texture.Height = (randomFraction(random) < corpus.NonSquare) ? std::max(1, texture.Width / 2) : texture.Width;
+		texture.Mipmaps = 0;
+		texture.SRGB = (nextRandom(random) % 2 == 0);
+
+		QStringList bones;
+		int bonecount = 1 + nextRandom(random) % std::max(1, corpus.MaxBones);
+		for(int b = 0; b < bonecount; b++)
+			bones.append(b == 0 ? QString("texture_%1").arg(i, 5, 10, QChar('0')) : QString("bone_%1").arg(b));
+		bool sections = randomFraction(random) < corpus.Sections;
+
+		QString directory = QString("group_%1").arg(i / 100, 3, 10, QChar('0'));
+		if(!root.mkpath(directory))
+		{
+			error = QString("Couldn't create %1").arg(root.absoluteFilePath(directory));
+			return false;
+		}
+
+		QString filename = root.absoluteFilePath(QString("%1/texture_%2.papa").arg(directory).arg(i, 5, 10, QChar('0')));
+		if(!write(filename, QList<texturespec_t>() << texture, bones, corpus.Seed + i, error, sections))
+			return false;
+		filenames.append(filename);
+	}
+
+	return true;
+}
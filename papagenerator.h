@@ -0,0 +1,69 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PAPAGENERATOR_H
+#define PAPAGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QImage>
+#include <QPair>
+
+// Writes made up .papa files, for benchmarks and tests that need textures
+// of a particular format and size. Everything is derived from the seed,
+// so the same arguments always give the same file.
+class PapaGenerator
+{
+public:
+	struct texturespec_t
+	{
+		int Format; // PapaFile::formatName
+		int Width;
+		int Height;
+		int Mipmaps; // 0 for the full chain
+		bool SRGB;
+	};
+
+	// A directory tree of files with one texture each, drawn at random from
+	// the weighted formats and sizes.
+	struct corpusspec_t
+	{
+		int Count;
+		QList<QPair<int, double> > Formats;
+		QList<QPair<int, double> > Sizes; // Of the longest edge
+		double NonSquare; // Chance of the height being half the width
+		int MaxBones;
+		double Sections; // Chance of vertices, indices, materials and meshes
+		quint32 Seed;
+	};
+
+	static bool write(const QString& filename, const QList<texturespec_t>& textures, const QStringList& bones, quint32 seed, QString& error, bool sections = false);
+	static corpusspec_t defaultCorpus();
+	static bool parseWeights(const QString& text, bool formats, QList<QPair<int, double> >& weights);
+	static bool writeCorpus(const QString& destination, const corpusspec_t& corpus, QStringList& filenames, QString& error);
+	static QImage image(int width, int height, quint32 seed);
+	static int fullMipChain(int width, int height);
+	static qint64 mipLength(int format, int width, int height);
+
+private:
+	static QByteArray textureData(const texturespec_t& texture, quint32 seed);
+};
+
+#endif // PAPAGENERATOR_H
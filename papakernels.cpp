@@ -0,0 +1,180 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "papakernels.h"
+#include <stdlib.h>
+#include <cmath>
+
+static void unpackRGBA(const uchar *data, quint32 *pixels, int count, bool alpha)
+{
+	for(int i = 0; i < count; i++, data += 4)
+		pixels[i] = ((alpha ? data[3] : 255u) << 24) | (data[0] << 16) | (data[1] << 8) | data[2];
+}
+
+static void packRGBA(const quint32 *pixels, uchar *data, int count, bool alpha)
+{
+	for(int i = 0; i < count; i++, data += 4)
+	{
+		data[0] = pixels[i] >> 16;
+		data[1] = pixels[i] >> 8;
+		data[2] = pixels[i];
+		if(alpha)
+			data[3] = pixels[i] >> 24;
+	}
+}
+
+static void decodeDXT1(const uchar *blocks, int count, quint32 *lines[4])
+{
+	for(int b = 0; b < count; b++, blocks += 8)
+	{
+		quint32 palette[4];
+		dxtColourPalette<true>(readLittleEndian(blocks, 2), readLittleEndian(blocks + 2, 2), palette);
+
+		quint32 bits = readLittleEndian(blocks + 4, 4);
+		for(int y = 0; y < 4; y++)
+		{
+			for(int x = 0; x < 4; x++, bits >>= 2)
+				lines[y][4*b + x] = palette[bits & 3];
+		}
+	}
+}
+
+static void decodeDXT5(const uchar *blocks, int count, quint32 *lines[4])
+{
+	for(int b = 0; b < count; b++, blocks += 16)
+	{
+		quint8 alphas[8];
+		dxtAlphaPalette(blocks[0], blocks[1], alphas);
+		quint32 palette[4];
+		dxtColourPalette<false>(readLittleEndian(blocks + 8, 2), readLittleEndian(blocks + 10, 2), palette);
+
+		quint64 alphabits = readLittleEndian(blocks + 2, 3) | ((quint64)readLittleEndian(blocks + 5, 3) << 24);
+		quint32 bits = readLittleEndian(blocks + 12, 4);
+		for(int y = 0; y < 4; y++)
+		{
+			for(int x = 0; x < 4; x++, bits >>= 2, alphabits >>= 3)
+				lines[y][4*b + x] = (palette[bits & 3] & 0x00ffffff) | (alphas[alphabits & 7] << 24);
+		}
+	}
+}
+
+static const PapaKernels::kernels_t Scalar = {"scalar", unpackRGBA, packRGBA, decodeDXT1, decodeDXT5, halveSRGBLines};
+
+const PapaKernels::kernels_t *PapaKernels::Selected = NULL;
+
+const PapaKernels::kernels_t *PapaKernels::scalar()
+{
+	return &Scalar;
+}
+
+bool PapaKernels::cpuHasSSE2()
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#else
+	return false;
+#endif
+}
+
+bool PapaKernels::cpuHasAVX2()
+{
+	// Also checks that the OS saves the AVX registers.
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+QList<const PapaKernels::kernels_t *> PapaKernels::available()
+{
+	QList<const kernels_t *> kernels;
+	kernels.append(scalar());
+	if(sse2() && cpuHasSSE2())
+		kernels.append(sse2());
+	if(avx2() && cpuHasAVX2())
+		kernels.append(avx2());
+	return kernels;
+}
+
+const PapaKernels::kernels_t *PapaKernels::choose()
+{
+	QList<const kernels_t *> kernels = available();
+	const char *name = getenv("PAPA_KERNELS");
+	if(name && *name)
+	{
+		for(int i = 0; i < kernels.count(); i++)
+		{
+			if(qstrcmp(kernels[i]->Name, name) == 0)
+				return kernels[i];
+		}
+		qWarning("PAPA_KERNELS=%s isn't available on this CPU, using %s", name, kernels.last()->Name);
+	}
+	return kernels.last();
+}
+
+const PapaKernels::kernels_t& PapaKernels::active()
+{
+	// Decided once, the first time any texture is decoded.
+	static const kernels_t *best = choose();
+	return Selected ? *Selected : *best;
+}
+
+bool PapaKernels::select(const QString& name)
+{
+	QList<const kernels_t *> kernels = available();
+	for(int i = 0; i < kernels.count(); i++)
+	{
+		if(name == kernels[i]->Name)
+		{
+			Selected = kernels[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+// From IEC 61966-2-1.
+static PapaKernels::srgbtables_t makeSRGBTables()
+{
+	PapaKernels::srgbtables_t tables;
+	for(int i = 0; i < 256; i++)
+	{
+		double value = i / 255.;
+		double linear = value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+		tables.ToLinear[i] = (quint32)(linear * 4095 + 0.5);
+	}
+	for(int i = 0; i < 4096; i++)
+	{
+		double linear = i / 4095.;
+		double value = linear <= 0.0031308 ? linear * 12.92 : 1.055 * pow(linear, 1 / 2.4) - 0.055;
+		tables.FromLinear[i] = (quint8)(value * 255 + 0.5);
+	}
+	for(int i = 4096; i < 4096 + 3; i++)
+		tables.FromLinear[i] = 0;
+	return tables;
+}
+
+const PapaKernels::srgbtables_t& PapaKernels::srgb()
+{
+	static const srgbtables_t tables = makeSRGBTables();
+	return tables;
+}
@@ -0,0 +1,181 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PAPAKERNELS_H
+#define PAPAKERNELS_H
+
+#include <QtGlobal>
+#include <QList>
+#include <QString>
+
+// The inner loops of the decoders and encoders, built once for every
+// instruction set in papakernels_*.cpp. The fastest one the CPU can run is
+// picked the first time they are needed. PAPA_KERNELS=scalar, sse2 or avx2
+// in the environment picks another one instead, for testing.
+//
+// Pixels are QRgb, 0xAARRGGBB. All of them have to give exactly the same
+// results as the scalar ones, conformance/ checks that.
+class PapaKernels
+{
+public:
+	typedef void (*blockdecoder_t)(const uchar *blocks, int count, quint32 *lines[4]);
+
+	struct kernels_t
+	{
+		const char *Name;
+
+		// From the R, G, B, A bytes in the file to pixels and back. Without
+		// alpha the pixels get 255 and the fourth byte is left alone.
+		void (*unpackRGBA)(const uchar *data, quint32 *pixels, int count, bool alpha);
+		void (*packRGBA)(const quint32 *pixels, uchar *data, int count, bool alpha);
+
+		// A row of count 4x4 blocks into four lines of 4 * count pixels.
+		blockdecoder_t decodeDXT1;
+		blockdecoder_t decodeDXT5;
+
+		// Every 2x2 pixels of line0 and line1, 2 * count wide, into one,
+		// averaged in linear light. Alpha is averaged as it is.
+		void (*halveSRGB)(const quint32 *line0, const quint32 *line1, quint32 *pixels, int count);
+	};
+
+	// sRGB to 12 bit linear and back, rounded to the nearest.
+	struct srgbtables_t
+	{
+		quint32 ToLinear[256];
+		quint8 FromLinear[4096 + 3]; // Padded so 32 bit gathers stay inside
+	};
+	static const srgbtables_t& srgb();
+
+	static const kernels_t& active();
+	static QList<const kernels_t *> available(); // Slowest first
+	static bool select(const QString& name);
+
+	// NULL when the compiler couldn't build them.
+	static const kernels_t *scalar();
+	static const kernels_t *sse2();
+	static const kernels_t *avx2();
+
+private:
+	static bool cpuHasSSE2();
+	static bool cpuHasAVX2();
+	static const kernels_t *choose();
+
+	static const kernels_t *Selected;
+};
+
+// The palettes are worked out the same way by every variant, only using
+// them is vectorised. Static so the ones built with AVX2 enabled stay in
+// their own file.
+
+static inline quint32 readLittleEndian(const uchar *data, int bytes)
+{
+	quint32 value = 0;
+	for(int i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | data[i];
+	return value;
+}
+
+static inline quint32 opaqueRgb(int red, int green, int blue)
+{
+	return 0xff000000u | (red << 16) | (green << 8) | blue;
+}
+
+// 255 * value / 32 and 255 * value / 64, how the 5 and 6 bit channels have
+// always been expanded to 8 bits.
+static const quint8 DxtExpand5[32] = {
+	0, 7, 15, 23, 31, 39, 47, 55, 63, 71, 79, 87, 95, 103, 111, 119,
+	127, 135, 143, 151, 159, 167, 175, 183, 191, 199, 207, 215, 223, 231, 239, 247
+};
+static const quint8 DxtExpand6[64] = {
+	0, 3, 7, 11, 15, 19, 23, 27, 31, 35, 39, 43, 47, 51, 55, 59,
+	63, 67, 71, 75, 79, 83, 87, 91, 95, 99, 103, 107, 111, 115, 119, 123,
+	127, 131, 135, 139, 143, 147, 151, 155, 159, 163, 167, 171, 175, 179, 183, 187,
+	191, 195, 199, 203, 207, 211, 215, 219, 223, 227, 231, 235, 239, 243, 247, 251
+};
+
+static inline quint32 dxtExpand(int red, int green, int blue)
+{
+	return opaqueRgb(DxtExpand5[red], DxtExpand6[green], DxtExpand5[blue]);
+}
+
+// DXT5 always has four colours, DXT1 has three and black if colour0 isn't
+// the larger one. A template so each format gets its own copy without the
+// test it doesn't need.
+template<bool threecolours> static inline void dxtColourPalette(quint16 colour0, quint16 colour1, quint32 palette[4])
+{
+	int red0 = colour0 >> 11, green0 = (colour0 >> 5) & 63, blue0 = colour0 & 31;
+	int red1 = colour1 >> 11, green1 = (colour1 >> 5) & 63, blue1 = colour1 & 31;
+
+	palette[0] = dxtExpand(red0, green0, blue0);
+	palette[1] = dxtExpand(red1, green1, blue1);
+	if(!threecolours || colour0 > colour1)
+	{
+		palette[2] = dxtExpand((2 * red0 + red1) / 3, (2 * green0 + green1) / 3, (2 * blue0 + blue1) / 3);
+		palette[3] = dxtExpand((red0 + 2 * red1) / 3, (green0 + 2 * green1) / 3, (blue0 + 2 * blue1) / 3);
+	}
+	else
+	{
+		palette[2] = dxtExpand((red0 + red1) / 2, (green0 + green1) / 2, (blue0 + blue1) / 2);
+		palette[3] = opaqueRgb(0, 0, 0);
+	}
+}
+
+// The weights of alpha0 and alpha1 in the interpolated alphas. Integer
+// division rounds down like the conversion from double used to, and the
+// compiler turns the constant divisors into multiplications.
+static const int DxtAlphaWeights7[6][2] = {{6, 1}, {5, 2}, {4, 3}, {3, 4}, {2, 5}, {1, 6}};
+static const int DxtAlphaWeights5[4][2] = {{4, 1}, {3, 2}, {2, 3}, {1, 4}};
+
+static inline void dxtAlphaPalette(quint8 alpha0, quint8 alpha1, quint8 palette[8])
+{
+	palette[0] = alpha0;
+	palette[1] = alpha1;
+	if(alpha0 > alpha1)
+	{
+		for(int k = 0; k < 6; k++)
+			palette[k+2] = (DxtAlphaWeights7[k][0] * alpha0 + DxtAlphaWeights7[k][1] * alpha1) / 7;
+	}
+	else
+	{
+		for(int k = 0; k < 4; k++)
+			palette[k+2] = (DxtAlphaWeights5[k][0] * alpha0 + DxtAlphaWeights5[k][1] * alpha1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static inline quint32 srgbAverage(const PapaKernels::srgbtables_t& tables, quint32 pixel0, quint32 pixel1, quint32 pixel2, quint32 pixel3)
+{
+	quint32 pixel = (((pixel0 >> 24) + (pixel1 >> 24) + (pixel2 >> 24) + (pixel3 >> 24) + 2) >> 2) << 24;
+	for(int shift = 0; shift < 24; shift += 8)
+	{
+		quint32 sum = tables.ToLinear[(pixel0 >> shift) & 255] + tables.ToLinear[(pixel1 >> shift) & 255] + tables.ToLinear[(pixel2 >> shift) & 255] + tables.ToLinear[(pixel3 >> shift) & 255];
+		pixel |= (quint32)tables.FromLinear[(sum + 2) >> 2] << shift;
+	}
+	return pixel;
+}
+
+static inline void halveSRGBLines(const quint32 *line0, const quint32 *line1, quint32 *pixels, int count)
+{
+	const PapaKernels::srgbtables_t& tables = PapaKernels::srgb();
+	for(int i = 0; i < count; i++)
+		pixels[i] = srgbAverage(tables, line0[2*i], line0[2*i + 1], line1[2*i], line1[2*i + 1]);
+}
+
+#endif // PAPAKERNELS_H
@@ -0,0 +1,172 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Built with -mavx2, only called when the CPU has it. See papakernels.h.
+
+#include "papakernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+static void unpackRGBA(const uchar *data, quint32 *pixels, int count, bool alpha)
+{
+	const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	__m256i opaque = _mm256_set1_epi32(alpha ? 0 : (int)0xff000000);
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i source = _mm256_loadu_si256((const __m256i *)(data + 4 * i));
+		_mm256_storeu_si256((__m256i *)(pixels + i), _mm256_or_si256(_mm256_shuffle_epi8(source, swap), opaque));
+	}
+	for(; i < count; i++)
+		pixels[i] = ((alpha ? data[4*i + 3] : 255u) << 24) | (data[4*i] << 16) | (data[4*i + 1] << 8) | data[4*i + 2];
+}
+
+static void packRGBA(const quint32 *pixels, uchar *data, int count, bool alpha)
+{
+	const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	__m256i keep = _mm256_set1_epi32(alpha ? 0 : (int)0xff000000); // The bytes of data that stay
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i swapped = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(pixels + i)), swap);
+		__m256i old = _mm256_loadu_si256((const __m256i *)(data + 4 * i));
+		_mm256_storeu_si256((__m256i *)(data + 4 * i), _mm256_blendv_epi8(swapped, old, keep));
+	}
+	for(; i < count; i++)
+	{
+		data[4*i] = pixels[i] >> 16;
+		data[4*i + 1] = pixels[i] >> 8;
+		data[4*i + 2] = pixels[i];
+		if(alpha)
+			data[4*i + 3] = pixels[i] >> 24;
+	}
+}
+
+// Two lines of a block at a time: the 2 bit indices are shifted into
+// place per lane and looked up with a permute, the palette repeated twice
+// to fill the register.
+static inline __m256i lookupLines(quint32 bits, __m256i palette)
+{
+	__m256i indices = _mm256_srlv_epi32(_mm256_set1_epi32(bits), _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14));
+	return _mm256_permutevar8x32_epi32(palette, _mm256_and_si256(indices, _mm256_set1_epi32(3)));
+}
+
+static inline void storeLines(__m256i pixels, quint32 *first, quint32 *second)
+{
+	_mm_storeu_si128((__m128i *)first, _mm256_castsi256_si128(pixels));
+	_mm_storeu_si128((__m128i *)second, _mm256_extracti128_si256(pixels, 1));
+}
+
+static void decodeDXT1(const uchar *blocks, int count, quint32 *lines[4])
+{
+	for(int b = 0; b < count; b++, blocks += 8)
+	{
+		quint32 colours[4];
+		dxtColourPalette<true>(readLittleEndian(blocks, 2), readLittleEndian(blocks + 2, 2), colours);
+		__m256i palette = _mm256_setr_epi32(colours[0], colours[1], colours[2], colours[3], colours[0], colours[1], colours[2], colours[3]);
+
+		quint32 bits = readLittleEndian(blocks + 4, 4);
+		storeLines(lookupLines(bits, palette), lines[0] + 4 * b, lines[1] + 4 * b);
+		storeLines(lookupLines(bits >> 16, palette), lines[2] + 4 * b, lines[3] + 4 * b);
+	}
+}
+
+static void decodeDXT5(const uchar *blocks, int count, quint32 *lines[4])
+{
+	const __m256i alphashifts = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	for(int b = 0; b < count; b++, blocks += 16)
+	{
+		// The eight alphas fill a register exactly, already in place.
+		quint8 alphas[8];
+		dxtAlphaPalette(blocks[0], blocks[1], alphas);
+		__m256i alphapalette = _mm256_slli_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)alphas)), 24);
+
+		quint32 colours[4];
+		dxtColourPalette<false>(readLittleEndian(blocks + 8, 2), readLittleEndian(blocks + 10, 2), colours);
+		__m256i palette = _mm256_and_si256(_mm256_setr_epi32(colours[0], colours[1], colours[2], colours[3], colours[0], colours[1], colours[2], colours[3]), _mm256_set1_epi32(0x00ffffff));
+
+		quint32 bits = readLittleEndian(blocks + 12, 4);
+		for(int half = 0; half < 2; half++)
+		{
+			// 24 bits of alpha indices for each two lines.
+			__m256i alphaindices = _mm256_srlv_epi32(_mm256_set1_epi32(readLittleEndian(blocks + 2 + 3 * half, 3)), alphashifts);
+			__m256i alpha = _mm256_permutevar8x32_epi32(alphapalette, _mm256_and_si256(alphaindices, _mm256_set1_epi32(7)));
+			__m256i pixels = _mm256_or_si256(lookupLines(bits >> (16 * half), palette), alpha);
+			storeLines(pixels, lines[2 * half] + 4 * b, lines[2 * half + 1] + 4 * b);
+		}
+	}
+}
+
+// One channel of 16 pixels of a line to linear, the neighbours added up:
+// 8 sums in the order of the pixels they came from.
+static inline __m256i linearPairs(const PapaKernels::srgbtables_t& tables, __m256i first, __m256i second, int shift)
+{
+	const __m256i mask = _mm256_set1_epi32(255);
+	__m256i linear0 = _mm256_i32gather_epi32((const int *)tables.ToLinear, _mm256_and_si256(_mm256_srli_epi32(first, shift), mask), 4);
+	__m256i linear1 = _mm256_i32gather_epi32((const int *)tables.ToLinear, _mm256_and_si256(_mm256_srli_epi32(second, shift), mask), 4);
+	return _mm256_permute4x64_epi64(_mm256_hadd_epi32(linear0, linear1), 0xd8);
+}
+
+static void halveSRGB(const quint32 *line0, const quint32 *line1, quint32 *pixels, int count)
+{
+	const PapaKernels::srgbtables_t& tables = PapaKernels::srgb();
+	const __m256i two = _mm256_set1_epi32(2);
+	const __m256i byte = _mm256_set1_epi32(255);
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i top0 = _mm256_loadu_si256((const __m256i *)(line0 + 2 * i));
+		__m256i top1 = _mm256_loadu_si256((const __m256i *)(line0 + 2 * i + 8));
+		__m256i bottom0 = _mm256_loadu_si256((const __m256i *)(line1 + 2 * i));
+		__m256i bottom1 = _mm256_loadu_si256((const __m256i *)(line1 + 2 * i + 8));
+
+		__m256i alphas = _mm256_add_epi32(
+			_mm256_hadd_epi32(_mm256_srli_epi32(top0, 24), _mm256_srli_epi32(top1, 24)),
+			_mm256_hadd_epi32(_mm256_srli_epi32(bottom0, 24), _mm256_srli_epi32(bottom1, 24)));
+		alphas = _mm256_permute4x64_epi64(alphas, 0xd8);
+		__m256i result = _mm256_slli_epi32(_mm256_srli_epi32(_mm256_add_epi32(alphas, two), 2), 24);
+
+		for(int shift = 0; shift < 24; shift += 8)
+		{
+			__m256i sums = _mm256_add_epi32(linearPairs(tables, top0, top1, shift), linearPairs(tables, bottom0, bottom1, shift));
+			__m256i average = _mm256_srli_epi32(_mm256_add_epi32(sums, two), 2);
+			__m256i value = _mm256_and_si256(_mm256_i32gather_epi32((const int *)tables.FromLinear, average, 1), byte);
+			result = _mm256_or_si256(result, _mm256_slli_epi32(value, shift));
+		}
+		_mm256_storeu_si256((__m256i *)(pixels + i), result);
+	}
+	halveSRGBLines(line0 + 2 * i, line1 + 2 * i, pixels + i, count - i);
+}
+
+static const PapaKernels::kernels_t Kernels = {"avx2", unpackRGBA, packRGBA, decodeDXT1, decodeDXT5, halveSRGB};
+
+const PapaKernels::kernels_t *PapaKernels::avx2()
+{
+	return &Kernels;
+}
+
+#else
+
+const PapaKernels::kernels_t *PapaKernels::avx2()
+{
+	return NULL;
+}
+
+#endif
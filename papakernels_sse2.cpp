@@ -0,0 +1,141 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Built with -msse2, only called when the CPU has it. See papakernels.h.
+
+#include "papakernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+// Swaps the first and third byte of every pixel, which turns R, G, B, A
+// into 0xAARRGGBB and back.
+static inline __m128i swapRedBlue(__m128i pixels)
+{
+	__m128i redblue = _mm_and_si128(pixels, _mm_set1_epi32(0x00ff00ff));
+	__m128i greenalpha = _mm_and_si128(pixels, _mm_set1_epi32((int)0xff00ff00));
+	return _mm_or_si128(greenalpha, _mm_or_si128(_mm_slli_epi32(redblue, 16), _mm_srli_epi32(redblue, 16)));
+}
+
+static void unpackRGBA(const uchar *data, quint32 *pixels, int count, bool alpha)
+{
+	__m128i opaque = _mm_set1_epi32(alpha ? 0 : (int)0xff000000);
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i source = _mm_loadu_si128((const __m128i *)(data + 4 * i));
+		_mm_storeu_si128((__m128i *)(pixels + i), _mm_or_si128(swapRedBlue(source), opaque));
+	}
+	for(; i < count; i++)
+		pixels[i] = ((alpha ? data[4*i + 3] : 255u) << 24) | (data[4*i] << 16) | (data[4*i + 1] << 8) | data[4*i + 2];
+}
+
+static void packRGBA(const quint32 *pixels, uchar *data, int count, bool alpha)
+{
+	__m128i keep = _mm_set1_epi32(alpha ? 0 : (int)0xff000000); // The bytes of data that stay
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i swapped = _mm_andnot_si128(keep, swapRedBlue(_mm_loadu_si128((const __m128i *)(pixels + i))));
+		__m128i old = _mm_and_si128(keep, _mm_loadu_si128((const __m128i *)(data + 4 * i)));
+		_mm_storeu_si128((__m128i *)(data + 4 * i), _mm_or_si128(swapped, old));
+	}
+	for(; i < count; i++)
+	{
+		data[4*i] = pixels[i] >> 16;
+		data[4*i + 1] = pixels[i] >> 8;
+		data[4*i + 2] = pixels[i];
+		if(alpha)
+			data[4*i + 3] = pixels[i] >> 24;
+	}
+}
+
+// Picks from the palette for the four 2 bit indices in the low byte of
+// bits, without variable shifts: each lane masks out its own index and
+// compares it with every possible value.
+static inline __m128i lookupRow(quint32 bits, const __m128i palette[4])
+{
+	__m128i indices = _mm_and_si128(_mm_set1_epi32(bits), _mm_setr_epi32(3, 3 << 2, 3 << 4, 3 << 6));
+	__m128i ones = _mm_setr_epi32(1, 1 << 2, 1 << 4, 1 << 6);
+	__m128i result = _mm_and_si128(_mm_cmpeq_epi32(indices, _mm_setzero_si128()), palette[0]);
+	result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(indices, ones), palette[1]));
+	result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(indices, _mm_add_epi32(ones, ones)), palette[2]));
+	return _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(indices, _mm_setr_epi32(3, 3 << 2, 3 << 4, 3 << 6)), palette[3]));
+}
+
+static void decodeDXT1(const uchar *blocks, int count, quint32 *lines[4])
+{
+	for(int b = 0; b < count; b++, blocks += 8)
+	{
+		quint32 colours[4];
+		dxtColourPalette<true>(readLittleEndian(blocks, 2), readLittleEndian(blocks + 2, 2), colours);
+		__m128i palette[4];
+		for(int i = 0; i < 4; i++)
+			palette[i] = _mm_set1_epi32(colours[i]);
+
+		quint32 bits = readLittleEndian(blocks + 4, 4);
+		for(int y = 0; y < 4; y++)
+			_mm_storeu_si128((__m128i *)(lines[y] + 4 * b), lookupRow(bits >> (8 * y), palette));
+	}
+}
+
+static void decodeDXT5(const uchar *blocks, int count, quint32 *lines[4])
+{
+	for(int b = 0; b < count; b++, blocks += 16)
+	{
+		// Eight alphas don't compare well, those are looked up one by one.
+		quint8 alphas[8];
+		dxtAlphaPalette(blocks[0], blocks[1], alphas);
+		quint64 alphabits = readLittleEndian(blocks + 2, 3) | ((quint64)readLittleEndian(blocks + 5, 3) << 24);
+		quint32 alpha[16];
+		for(int i = 0; i < 16; i++, alphabits >>= 3)
+			alpha[i] = alphas[alphabits & 7] << 24;
+
+		quint32 colours[4];
+		dxtColourPalette<false>(readLittleEndian(blocks + 8, 2), readLittleEndian(blocks + 10, 2), colours);
+		__m128i palette[4];
+		for(int i = 0; i < 4; i++)
+			palette[i] = _mm_set1_epi32(colours[i] & 0x00ffffff);
+
+		quint32 bits = readLittleEndian(blocks + 12, 4);
+		for(int y = 0; y < 4; y++)
+		{
+			__m128i row = _mm_or_si128(lookupRow(bits >> (8 * y), palette), _mm_loadu_si128((const __m128i *)(alpha + 4 * y)));
+			_mm_storeu_si128((__m128i *)(lines[y] + 4 * b), row);
+		}
+	}
+}
+
+// Without gathers the table lookups can't be vectorised, so the mipmaps
+// are made the same way as by the scalar kernels.
+static const PapaKernels::kernels_t Kernels = {"sse2", unpackRGBA, packRGBA, decodeDXT1, decodeDXT5, halveSRGBLines};
+
+const PapaKernels::kernels_t *PapaKernels::sse2()
+{
+	return &Kernels;
+}
+
+#else
+
+const PapaKernels::kernels_t *PapaKernels::sse2()
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "papastats.h"
+#include <QMutexLocker>
+#include <QStringList>
+
+bool PapaStats::Enabled = false;
+const char *PapaStats::TimerNames[TimerCount] = {"load", "read", "decode", "encode", "store"};
+
+PapaStats::PapaStats()
+{
+	reset();
+}
+
+PapaStats& PapaStats::global()
+{
+	static PapaStats stats;
+	return stats;
+}
+
+void PapaStats::record(PapaStats::counter_t counter, qint64 amount)
+{
+	{
+		QMutexLocker locker(&Mutex);
+		Values.Counters[counter] += amount;
+	}
+	if(this != &global())
+		global().record(counter, amount);
+}
+
+void PapaStats::addTime(PapaStats::timer_t timer, qint64 nanoseconds)
+{
+	{
+		QMutexLocker locker(&Mutex);
+		Values.Calls[timer]++;
+		Values.Nanoseconds[timer] += nanoseconds;
+	}
+	if(this != &global())
+		global().addTime(timer, nanoseconds);
+}
+
+PapaStats::values_t PapaStats::values()
+{
+	QMutexLocker locker(&Mutex);
+	return Values;
+}
+
+void PapaStats::reset()
+{
+	QMutexLocker locker(&Mutex);
+	for(int i = 0; i < CounterCount; i++)
+		Values.Counters[i] = 0;
+	for(int i = 0; i < TimerCount; i++)
+		Values.Calls[i] = Values.Nanoseconds[i] = 0;
+}
+
+QString PapaStats::report(const PapaStats::values_t& values)
+{
+	static const char *counters[CounterCount] = {"bytes read", "bytes written", "blocks decoded", "blocks encoded", "allocations", "cache hits", "cache misses"};
+
+	QStringList lines;
+	for(int i = 0; i < TimerCount; i++)
+	{
+		if(values.Calls[i] == 0)
+			continue;
+		lines.append(QString("%1 %2 calls %3 ms %4 ms/call")
+			.arg(TimerNames[i], -14)
+			.arg(values.Calls[i], 8)
+			.arg(values.Nanoseconds[i] / 1e6, 10, 'f', 2)
+			.arg(values.Nanoseconds[i] / 1e6 / values.Calls[i], 9, 'f', 3));
+	}
+	for(int i = 0; i < CounterCount; i++)
+		lines.append(QString("%1 %2").arg(counters[i], -14).arg(values.Counters[i], 8));
+
+	return lines.join("\n");
+}
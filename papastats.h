@@ -0,0 +1,98 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PAPASTATS_H
+#define PAPASTATS_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include "papatrace.h"
+
+// Timers and counters for the codec, kept per file and for the whole
+// process. They are off until setEnabled is called, until then every
+// update is the check of one flag.
+class PapaStats
+{
+public:
+	enum counter_t
+	{
+		BytesRead,
+		BytesWritten,
+		BlocksDecoded, // 4x4, also for the uncompressed formats
+		BlocksEncoded,
+		Allocations, // Buffers and images the codec made
+		CacheHits, // Mipmaps that were decoded already
+		CacheMisses,
+		CounterCount
+	};
+
+	enum timer_t
+	{
+		Load,
+		Read,
+		Decode,
+		Encode, // Includes decoding what wasn't decoded yet
+		Store,
+		TimerCount
+	};
+
+	struct values_t
+	{
+		qint64 Counters[CounterCount];
+		qint64 Calls[TimerCount];
+		qint64 Nanoseconds[TimerCount];
+	};
+
+	// Adds the time until it goes out of scope, and is a span in the trace
+	// if one is being recorded.
+	class Timer
+	{
+	public:
+		Timer(PapaStats& stats, timer_t timer, const QString& detail = QString()) : Stats(Enabled ? &stats : NULL), Which(timer), Span(timerName(timer), detail) {if(Stats) Elapsed.start();}
+		~Timer() {if(Stats) Stats->addTime(Which, Elapsed.nsecsElapsed());}
+
+	private:
+		PapaStats *Stats;
+		timer_t Which;
+		QElapsedTimer Elapsed;
+		PapaTrace::Span Span;
+	};
+
+	PapaStats();
+	static void setEnabled(bool enabled) {Enabled = enabled;}
+	static bool enabled() {return Enabled;}
+	static PapaStats& global();
+	void add(counter_t counter, qint64 amount = 1) {if(Enabled) record(counter, amount);}
+	void addTime(timer_t timer, qint64 nanoseconds);
+	values_t values();
+	void reset();
+	static QString report(const values_t& values);
+	static const char *timerName(timer_t timer) {return TimerNames[timer];}
+
+private:
+	void record(counter_t counter, qint64 amount);
+
+	static bool Enabled;
+	static const char *TimerNames[TimerCount];
+	QMutex Mutex;
+	values_t Values;
+};
+
+#endif // PAPASTATS_H
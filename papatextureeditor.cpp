@@ -7,23 +7,32 @@
 #include <QPainter>
 #include <QImageReader>
 #include <QSplitter>
-#include <QScrollArea>
 #include <QTreeView>
+#include <QListView>
+#include <QStackedWidget>
 #include <QFileDialog>
 #include <QFile>
 #include <QMessageBox>
 #include <QVBoxLayout>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QStatusBar>
+#include <QHBoxLayout>
+#include <QTimer>
 #include <qimagewriter.h>
 #include <QDebug>
 #include <QSettings>
 #include "texturelistmodel.h"
 #include "papafile.h"
 #include "helpdialog.h"
+#include "textureviewer.h"
+#include "mipmapdecoder.h"
+#include "papatrace.h"
 
 #define VERSION "0.4.1"
 
 PapaTextureEditor::PapaTextureEditor()
- : Image(NULL), Label(NULL), Model(NULL), TextureList(NULL), InfoLabel(NULL)
+ : Viewer(NULL), Decoder(NULL), Model(NULL), TextureList(NULL), TextureGrid(NULL), TextureViews(NULL), InfoLabel(NULL), DiagnosticsLabel(NULL), DiagnosticsTimer(NULL), TaskProgress(NULL), CancelButton(NULL), TaskRunning(false)
 {
 	setMinimumSize(1000, 700);
 
@@ -32,30 +41,78 @@ PapaTextureEditor::PapaTextureEditor()
 
 	QVBoxLayout *rightSideLayout = new QVBoxLayout(rightSideWidget);
 
-	QScrollArea *scrollarea = new QScrollArea(rightSideWidget);
-	Label = new QLabel(scrollarea);
-	scrollarea->setWidget(Label);
-
-	TextureList = new QTreeView(this);
 	Model = new TextureListModel(this);
+	Viewer = new TextureViewer(rightSideWidget);
+	Decoder = new MipmapDecoder(Model->scheduler(), this);
+	connect(Decoder, SIGNAL(mipmapReady(int, const QImage &)), Viewer, SLOT(setMipmap(int, const QImage &)));
+
+	TextureViews = new QStackedWidget(this);
+	TextureViews->setMaximumWidth(400);
+	TextureList = new QTreeView(TextureViews);
 	TextureList->setModel(Model);
 	TextureList->setRootIsDecorated(false);
-	TextureList->setMaximumWidth(400);
+	TextureList->setUniformRowHeights(true);
 	TextureList->setSelectionMode(QAbstractItemView::SingleSelection);
-	connect(TextureList, SIGNAL(activated(const QModelIndex &)), SLOT(textureClicked(const QModelIndex &)));
+	connect(TextureList->selectionModel(), SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)), SLOT(textureClicked(const QModelIndex &)));
+
+	// The grid shares the selection with the list, so either can be used to
+	// find the current texture.
+	TextureGrid = new QListView(TextureViews);
+	TextureGrid->setModel(Model);
+	TextureGrid->setSelectionModel(TextureList->selectionModel());
+	TextureGrid->setSelectionMode(QAbstractItemView::SingleSelection);
+	TextureGrid->setViewMode(QListView::IconMode);
+	TextureGrid->setMovement(QListView::Static);
+	TextureGrid->setResizeMode(QListView::Adjust);
+	TextureGrid->setLayoutMode(QListView::Batched);
+	TextureGrid->setBatchSize(500);
+	TextureGrid->setUniformItemSizes(true);
+	TextureGrid->setIconSize(Model->thumbnailSize());
+	TextureGrid->setGridSize(Model->thumbnailSize() + QSize(32, 32));
+	TextureGrid->setTextElideMode(Qt::ElideLeft);
+
+	TextureViews->addWidget(TextureList);
+	TextureViews->addWidget(TextureGrid);
+	connect(Model, SIGNAL(textureReplaced(const QModelIndex &)), SLOT(textureReplaced(const QModelIndex &)));
+	connect(Model, SIGNAL(taskProgress(int, int)), SLOT(taskProgress(int, int)));
+	connect(Model, SIGNAL(taskFinished(int, bool, const QString &)), SLOT(taskFinished(int, bool, const QString &)));
 	
 	InfoLabel = new QLabel(rightSideWidget);
 	InfoLabel->setText("Info");
 //	InfoLabel->setFixedHeight(50);
 
-	horsplitter->addWidget(TextureList);
-	rightSideLayout->addWidget(scrollarea);
-	rightSideLayout->addWidget(InfoLabel);
+	// Where the codec spends its time, for the selected texture and overall.
+	DiagnosticsLabel = new QLabel(rightSideWidget);
+	DiagnosticsLabel->setFont(QFont("Monospace"));
+	DiagnosticsLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+	DiagnosticsLabel->hide();
+	DiagnosticsTimer = new QTimer(this);
+	DiagnosticsTimer->setInterval(1000);
+	connect(DiagnosticsTimer, SIGNAL(timeout()), SLOT(updateDiagnostics()));
+
+	QHBoxLayout *infoLayout = new QHBoxLayout();
+	infoLayout->addWidget(InfoLabel, 1);
+	infoLayout->addWidget(DiagnosticsLabel);
+
+	horsplitter->addWidget(TextureViews);
+	rightSideLayout->addWidget(Viewer);
+	rightSideLayout->addLayout(infoLayout);
 	
 	horsplitter->addWidget(rightSideWidget);
 
 
 	setCentralWidget( horsplitter );
+
+	// Shown while saving, importing or exporting in the background.
+	TaskProgress = new QProgressBar(this);
+	TaskProgress->setMaximumWidth(300);
+	TaskProgress->hide();
+	CancelButton = new QPushButton("Cancel", this);
+	CancelButton->hide();
+	connect(CancelButton, SIGNAL(clicked()), Model, SLOT(cancelTasks()));
+	statusBar()->addPermanentWidget(TaskProgress);
+	statusBar()->addPermanentWidget(CancelButton);
+
 	QAction* quitAction = new QAction(this);
 	quitAction->setText( "&Quit" );
 	quitAction->setMenuRole(QAction::QuitRole);
@@ -81,14 +138,19 @@ PapaTextureEditor::PapaTextureEditor()
 	openAction->setText( "&Open directory..." );
 	openAction->setShortcut(QKeySequence("Ctrl+o"));
 	openAction->setIcon(style()->standardIcon(QStyle::SP_DirOpenIcon));
+	WatchAction = new QAction(this);
+	WatchAction->setText( "&Watch directory" );
+	WatchAction->setCheckable(true);
 	connect(quitAction, SIGNAL(triggered()), SLOT(close()));
 	connect(SaveAction, SIGNAL(triggered()), SLOT(savePapa()));
 	connect(SaveAsAction, SIGNAL(triggered()), SLOT(saveAsPapa()));
 	connect(ImportAction, SIGNAL(triggered()), SLOT(importImage()));
 	connect(ExportAction, SIGNAL(triggered()), SLOT(exportImage()));
 	connect(openAction, SIGNAL(triggered()), SLOT(openDirectory()));
+	connect(WatchAction, SIGNAL(toggled(bool)), SLOT(watchDirectory(bool)));
 	QMenu *menu = menuBar()->addMenu("&File");
 	menu->addAction(openAction);
+	menu->addAction(WatchAction);
 	menu->addAction(ImportAction);
 	menu->addAction(ExportAction);
 	menu->addAction(SaveAction);
@@ -105,6 +167,35 @@ PapaTextureEditor::PapaTextureEditor()
 	helpAction->setIcon(style()->standardIcon(QStyle::SP_DialogHelpButton));
 	helpAction->setShortcut(QKeySequence("f1"));
 	connect(helpAction, SIGNAL(triggered()), SLOT(help()));
+	ThumbnailAction = new QAction(this);
+	ThumbnailAction->setText("&Thumbnails");
+	ThumbnailAction->setCheckable(true);
+	ThumbnailAction->setShortcut(QKeySequence("Ctrl+t"));
+	connect(ThumbnailAction, SIGNAL(toggled(bool)), SLOT(showThumbnails(bool)));
+	DiagnosticsAction = new QAction(this);
+	DiagnosticsAction->setText("&Diagnostics");
+	DiagnosticsAction->setCheckable(true);
+	connect(DiagnosticsAction, SIGNAL(toggled(bool)), SLOT(showDiagnostics(bool)));
+	QAction* zoomInAction = new QAction(this);
+	zoomInAction->setText("Zoom &in");
+	zoomInAction->setShortcut(QKeySequence::ZoomIn);
+	connect(zoomInAction, SIGNAL(triggered()), Viewer, SLOT(zoomIn()));
+	QAction* zoomOutAction = new QAction(this);
+	zoomOutAction->setText("Zoom &out");
+	zoomOutAction->setShortcut(QKeySequence::ZoomOut);
+	connect(zoomOutAction, SIGNAL(triggered()), Viewer, SLOT(zoomOut()));
+	QAction* actualSizeAction = new QAction(this);
+	actualSizeAction->setText("&Actual size");
+	actualSizeAction->setShortcut(QKeySequence("Ctrl+0"));
+	connect(actualSizeAction, SIGNAL(triggered()), Viewer, SLOT(resetZoom()));
+	QMenu *viewMenu = menuBar()->addMenu("&View");
+	viewMenu->addAction(ThumbnailAction);
+	viewMenu->addAction(DiagnosticsAction);
+	viewMenu->addSeparator();
+	viewMenu->addAction(zoomInAction);
+	viewMenu->addAction(zoomOutAction);
+	viewMenu->addAction(actualSizeAction);
+
 	QMenu *helpMenu = menuBar()->addMenu("&Help");
 	helpMenu->addAction(helpAction);
 	helpMenu->addAction(aboutAction);
@@ -113,16 +204,22 @@ PapaTextureEditor::PapaTextureEditor()
 	SaveAction->setEnabled(false);
 	SaveAsAction->setEnabled(false);
 	ExportAction->setEnabled(false);
+
+	QSettings settings("DeathByDenim", "papatextureeditor");
+	WatchAction->setChecked(settings.value("watchdirectory", false).toBool());
+	ThumbnailAction->setChecked(settings.value("thumbnails", false).toBool());
+	DiagnosticsAction->setChecked(settings.value("diagnostics", false).toBool());
 }
 
 PapaTextureEditor::~PapaTextureEditor()
 {
+	// Has to go before the model and its scheduler.
+	delete Decoder;
 }
 
 void PapaTextureEditor::savePapa()
 {
-	if(!Model->savePapa(TextureList->currentIndex()))
-		QMessageBox::critical(this, "Save failed", "Couldn't save file, reason: " + Model->lastError());
+	startTask(Model->savePapa(TextureList->currentIndex()));
 }
 
 void PapaTextureEditor::saveAsPapa()
@@ -132,8 +229,7 @@ void PapaTextureEditor::saveAsPapa()
 	if(Model && filename.length() > 0)
 	{
 		settings.setValue("saveasdirectory", QFileInfo(filename).absolutePath());
-		if(!Model->savePapa(TextureList->currentIndex(), filename))
-			QMessageBox::critical(this, "Save failed", "Couldn't save file, reason: " + Model->lastError());
+		startTask(Model->savePapa(TextureList->currentIndex(), filename));
 	}
 }
 
@@ -153,35 +249,153 @@ void PapaTextureEditor::openDirectory()
 
 void PapaTextureEditor::textureClicked(const QModelIndex& index)
 {
+	PapaTrace::Span span("select texture");
 	PapaFile *papa = Model->papa(index);
 	if(papa)
 	{
-		const QImage *im = papa->image(0);
-		if(im)
-		{
-			Label->setPixmap(QPixmap::fromImage((*im)));
-			Label->setFixedSize((*im).size());
-		}
-		else
+		// Show the smallest mipmap scaled up straight away, the larger ones
+		// follow as they are decoded in the background. A texture that some
+		// job is busy with is left to the decoder entirely, rather than
+		// waiting for it here.
+		int lastmip = papa->mipCount(0) - 1;
+		Viewer->setTextureSize(papa->size(0), papa->mipCount(0));
+		QImage smallest = (lastmip >= 0) ? papa->tryMipmap(0, lastmip) : QImage();
+		if(!smallest.isNull())
 		{
-			QPixmap p;
-			Label->setPixmap(p);
+			Viewer->setMipmap(lastmip, smallest);
+			lastmip--;
 		}
+		Decoder->decode(Model->sharedPapa(index), lastmip);
+		Model->prefetch(index);
 
 		InfoLabel->setText(Model->info(index));
-
-		ImportAction->setEnabled(Model->isEditable(index));
-		SaveAction->setEnabled(Model->isEditable(index));
-		SaveAsAction->setEnabled(Model->isEditable(index));
-		ExportAction->setEnabled(im != NULL);
+		updateDiagnostics();
 	}
 	else
 	{
-		ImportAction->setEnabled(false);
-		SaveAction->setEnabled(false);
-		SaveAsAction->setEnabled(false);
-		ExportAction->setEnabled(false);
+		Decoder->cancel();
+		Viewer->clear();
+		Model->prefetch(QModelIndex());
+	}
+
+	updateActions(index);
+}
+
+void PapaTextureEditor::updateActions(const QModelIndex& index)
+{
+	// Only one save, import or export at a time.
+	PapaFile *papa = Model->papa(index);
+	bool editable = papa && !TaskRunning && Model->isEditable(index);
+	ImportAction->setEnabled(editable);
+	SaveAction->setEnabled(editable);
+	SaveAsAction->setEnabled(editable);
+	ExportAction->setEnabled(papa && !TaskRunning && !Model->isBusy(index) && papa->mipCount(0) > 0);
+}
+
+void PapaTextureEditor::startTask(bool started)
+{
+	if(!started)
+	{
+		QMessageBox::critical(this, "Busy", "This texture is busy, or its format can't be encoded yet.");
+		return;
 	}
+
+	TaskRunning = true;
+	TaskProgress->setRange(0, 0);
+	TaskProgress->show();
+	CancelButton->setEnabled(true);
+	CancelButton->show();
+	updateActions(TextureList->currentIndex());
+}
+
+void PapaTextureEditor::taskProgress(int value, int maximum)
+{
+	TaskProgress->setRange(0, maximum);
+	TaskProgress->setValue(value);
+}
+
+void PapaTextureEditor::taskFinished(int task, bool success, const QString& error)
+{
+	TaskRunning = false;
+	TaskProgress->hide();
+	CancelButton->hide();
+	updateActions(TextureList->currentIndex());
+
+	if(success || error == "Cancelled.")
+		return;
+
+	switch(task)
+	{
+		case TextureListModel::SaveTask:
+			QMessageBox::critical(this, "Save failed", "Couldn't save file, reason: " + error);
+			break;
+		case TextureListModel::ImportTask:
+			QMessageBox::critical(this, "Import failed", "Couldn't import the image, reason: " + error);
+			break;
+		case TextureListModel::ExportTask:
+			QMessageBox::critical(this, "Export failed", "Couldn't export the image, reason: " + error);
+			break;
+	}
+}
+
+void PapaTextureEditor::textureReplaced(const QModelIndex& index)
+{
+	// Show the new contents if the current texture was changed on disk or
+	// imported into. Thumbnails and task state don't need the viewer redone.
+	QModelIndex current = TextureList->currentIndex();
+	if(current.isValid() && current.row() == index.row())
+		textureClicked(current);
+}
+
+void PapaTextureEditor::watchDirectory(bool watch)
+{
+	QSettings settings("DeathByDenim", "papatextureeditor");
+	settings.setValue("watchdirectory", watch);
+	if(Model)
+		Model->setWatching(watch);
+}
+
+void PapaTextureEditor::showThumbnails(bool show)
+{
+	QSettings settings("DeathByDenim", "papatextureeditor");
+	settings.setValue("thumbnails", show);
+
+	Model->setThumbnails(show);
+	TextureViews->setCurrentWidget(show ? (QWidget *)TextureGrid : (QWidget *)TextureList);
+	TextureViews->setMaximumWidth(show ? QWIDGETSIZE_MAX : 400);
+	if(TextureList->currentIndex().isValid())
+		TextureViews->currentWidget()->setFocus();
+}
+
+void PapaTextureEditor::showDiagnostics(bool show)
+{
+	QSettings settings("DeathByDenim", "papatextureeditor");
+	settings.setValue("diagnostics", show);
+
+	// Counting only starts now, that keeps it free while nobody looks.
+	PapaStats::setEnabled(show);
+	DiagnosticsAction->setChecked(show);
+	DiagnosticsLabel->setVisible(show);
+	if(show)
+	{
+		DiagnosticsTimer->start();
+		updateDiagnostics();
+	}
+	else
+		DiagnosticsTimer->stop();
+}
+
+void PapaTextureEditor::updateDiagnostics()
+{
+	if(!DiagnosticsAction->isChecked())
+		return;
+
+	QString text;
+	PapaFile *papa = TextureList->currentIndex().isValid() ? Model->papa(TextureList->currentIndex()) : NULL;
+	if(papa)
+		text = "This texture\n" + PapaStats::report(papa->stats()) + "\n\n";
+	text += "All textures\n" + PapaStats::report(PapaStats::global().values());
+	DiagnosticsLabel->setText(text);
 }
 
 void PapaTextureEditor::importImage()
@@ -204,10 +418,7 @@ void PapaTextureEditor::importImage()
 	if(TextureList && Model && filename.length() > 0)
 	{
 		settings.setValue("importdirectory", QFileInfo(filename).canonicalPath());
-		if(Model->importImage(filename, TextureList->currentIndex()))
-			textureClicked(TextureList->currentIndex());
-		else
-			QMessageBox::critical(this, "Import failed", "I won't tell you why it failed, but this might be it:\n- The import image must be the same resolution at the current texture.\n- The texture format must be RGBA. I haven't finshed the others yet.\n- The papa file was read-only.");
+		startTask(Model->importImage(filename, TextureList->currentIndex()));
 	}
 }
 
@@ -217,11 +428,7 @@ void PapaTextureEditor::exportImage()
 		return;
 
 	PapaFile *papa = Model->papa(TextureList->currentIndex());
-	if(!papa)
-		return;
-	
-	const QImage *im = papa->image(0);
-	if(!im)
+	if(!papa || papa->mipCount(0) == 0)
 		return;
 
 	QString filter = "Portable Network Graphics (PNG)(*.png)";
@@ -239,13 +446,8 @@ void PapaTextureEditor::exportImage()
 	QString filename = QFileDialog::getSaveFileName(this, "Save image", settings.value("exportdirectory").toString(), filter);
 	if(filename.length() > 0)
 	{
-		QImageWriter writer(filename);
-		QByteArray format;
-		format.append(QFileInfo(filename).suffix());
-		writer.setFormat(format);
-		writer.write((*im));
-
-		settings.setValue("exportdirectory", QFileInfo(filename).canonicalPath());
+		settings.setValue("exportdirectory", QFileInfo(filename).absolutePath());
+		startTask(Model->exportImage(TextureList->currentIndex(), filename));
 	}
 }
 
@@ -262,7 +464,6 @@ void PapaTextureEditor::help()
 
 void PapaTextureEditor::openDir(QDir openme)
 {
-	qDebug() << openme;
 	if(Model)
 	{
 		if(!Model->loadFromDirectory(openme.absolutePath()))
@@ -8,21 +8,41 @@ class TextureListModel;
 class QLabel;
 class QModelIndex;
 class QTreeView;
+class QListView;
+class QStackedWidget;
+class QProgressBar;
+class QPushButton;
+class QTimer;
+class TextureViewer;
+class MipmapDecoder;
 
 class PapaTextureEditor : public QMainWindow
 {
 Q_OBJECT
 
 private:
-	QImage *Image;
-	QLabel *Label;
+	TextureViewer *Viewer;
+	MipmapDecoder *Decoder;
 	TextureListModel* Model;
 	QTreeView* TextureList;
+	QListView* TextureGrid;
+	QStackedWidget* TextureViews;
 	QLabel* InfoLabel;
+	QLabel* DiagnosticsLabel;
+	QTimer* DiagnosticsTimer;
+	QProgressBar* TaskProgress;
+	QPushButton* CancelButton;
+	bool TaskRunning;
 	QAction* ImportAction;
 	QAction* SaveAction;
 	QAction* SaveAsAction;
     QAction* ExportAction;
+	QAction* WatchAction;
+	QAction* ThumbnailAction;
+	QAction* DiagnosticsAction;
+	void startTask(bool started);
+	void updateActions(const QModelIndex& index);
+
 public:
 	PapaTextureEditor();
 	virtual ~PapaTextureEditor();
@@ -36,6 +56,13 @@ public slots:
 	void savePapa();
 	void saveAsPapa();
 	void textureClicked(const QModelIndex& index);
+	void textureReplaced(const QModelIndex& index);
+	void watchDirectory(bool watch);
+	void showThumbnails(bool show);
+	void showDiagnostics(bool show);
+	void updateDiagnostics();
+	void taskProgress(int value, int maximum);
+	void taskFinished(int task, bool success, const QString& error);
 	void about();
 	void help();
 };
@@ -0,0 +1,406 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocalSocket>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include "batchexporter.h"
+#include "batchimporter.h"
+#include "batchscanner.h"
+#include "conversionserver.h"
+#include "papagenerator.h"
+#include "papastats.h"
+#include "papatrace.h"
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+static int usage()
+{
+	err << "Usage: papatool <command> [options] <arguments>\n"
+	       "\n"
+	       "Commands:\n"
+	       "  export [-j threads] [--mipmaps] [--format png|tga|...] <source> <destination>\n"
+	       "      Exports every texture under source (a .papa file or a directory tree)\n"
+	       "      to image files in destination, mirroring the directory structure.\n"
+	       "  import [-j threads] [--dry-run] <images> <papas>\n"
+	       "  import [-j threads] [--dry-run] --manifest <file>\n"
+	       "      Imports images into the textures with the same path under papas, or\n"
+	       "      the image<tab>papa pairs listed in the manifest, then regenerates the\n"
+	       "      mipmaps and saves. A dry run encodes but doesn't save.\n"
+	       "  build [-j threads] [--state file] <images> <papas>\n"
+	       "  build [-j threads] [--state file] --manifest <file>\n"
+	       "      Like import, but only for the textures whose image, format or encoder\n"
+	       "      changed since the last build. The hashes are kept in the state file,\n"
+	       "      papas/.papatool-build or the manifest's name plus .state by default.\n"
+	       "  scan [-j threads] [--csv] <source> [output]\n"
+	       "      Lists the header contents of every .papa under source as JSON Lines\n"
+	       "      (or CSV), without decoding anything. Writes to stdout by default.\n"
+	       "  serve [-j threads] <socket>\n"
+	       "      Keeps running and does the conversions sent to the local socket, see\n"
+	       "      conversionserver.h for the protocol.\n"
+	       "  client <socket> <operation> [arguments]\n"
+	       "  client <socket> -\n"
+	       "      Sends one request to a server, or one per line of stdin with the\n"
+	       "      operation and arguments separated by tabs. The operations are\n"
+	       "      inspect <papa>, decode <papa> <image> [texture mipmap],\n"
+	       "      encode <image> <papa>, status and shutdown.\n"
+	       "  generate [--count n] [--formats DXT1:50,...] [--sizes 256:30,...] [--seed n]\n"
+	       "           [--non-square fraction] [--bones n] [--sections fraction] <destination>\n"
+	       "      Writes a corpus of made up textures for benchmarks, picking formats\n"
+	       "      and sizes with the given weights. Any format can be asked for, also\n"
+	       "      the ones the editor can't open.\n"
+	       "\n"
+	       "With --stats, any command prints where the codec spent its time to stderr.\n"
+	       "With --trace <file>, it records every load, decode, encode and write per\n"
+	       "thread and writes them to file as a Chrome trace, for Perfetto or\n"
+	       "about:tracing.\n";
+	err.flush();
+	return 2;
+}
+
+// Takes the value of an option like "-j 4" out of the arguments.
+static bool takeOption(QStringList& arguments, const QString& name, QString& value)
+{
+	int index = arguments.indexOf(name);
+	if(index < 0 || index + 1 >= arguments.count())
+		return false;
+
+	value = arguments[index + 1];
+	arguments.removeAt(index);
+	arguments.removeAt(index);
+	return true;
+}
+
+static bool takeFlag(QStringList& arguments, const QString& name)
+{
+	return arguments.removeAll(name) > 0;
+}
+
+static int threadCount(QStringList& arguments)
+{
+	QString value;
+	if(takeOption(arguments, "-j", value) && value.toInt() > 0)
+		return value.toInt();
+	return QThread::idealThreadCount();
+}
+
+static int exportCommand(QStringList arguments)
+{
+	BatchExporter exporter;
+	exporter.setThreadCount(threadCount(arguments));
+	exporter.setMipmaps(takeFlag(arguments, "--mipmaps"));
+	QString format;
+	if(takeOption(arguments, "--format", format))
+		exporter.setFormat(format.toLower());
+
+	if(arguments.count() != 2)
+		return usage();
+
+	bool success = exporter.run(arguments[0], arguments[1]);
+	QStringList errors = exporter.errors();
+	for(QStringList::const_iterator error = errors.constBegin(); error != errors.constEnd(); ++error)
+		err << *error << '\n';
+	err.flush();
+	out << exporter.utilisation() << '\n';
+	out << exporter.summary() << '\n';
+	out.flush();
+
+	return success ? 0 : 1;
+}
+
+static int importCommand(QStringList arguments, bool incremental)
+{
+	BatchImporter importer;
+	importer.setThreadCount(threadCount(arguments));
+	importer.setDryRun(takeFlag(arguments, "--dry-run"));
+	// Only build keeps a state, left in the arguments import fails on it.
+	QString state;
+	if(incremental)
+		takeOption(arguments, "--state", state);
+
+	bool success;
+	QString manifest;
+	if(takeOption(arguments, "--manifest", manifest) && arguments.isEmpty())
+	{
+		if(incremental)
+			importer.setBuildState(state.isEmpty() ? manifest + ".state" : state);
+		success = importer.runManifest(manifest);
+	}
+	else if(manifest.isEmpty() && arguments.count() == 2)
+	{
+		if(incremental)
+			importer.setBuildState(state.isEmpty() ? QDir(arguments[1]).absoluteFilePath(".papatool-build") : state);
+		success = importer.runDirectories(arguments[0], arguments[1]);
+	}
+	else
+		return usage();
+
+	QStringList timings = importer.timings();
+	for(QStringList::const_iterator timing = timings.constBegin(); timing != timings.constEnd(); ++timing)
+		out << *timing << '\n';
+	QStringList errors = importer.errors();
+	for(QStringList::const_iterator error = errors.constBegin(); error != errors.constEnd(); ++error)
+		err << *error << '\n';
+	err.flush();
+	out << importer.utilisation() << '\n';
+	out << importer.summary() << '\n';
+	out.flush();
+
+	return success ? 0 : 1;
+}
+
+static int scanCommand(QStringList arguments)
+{
+	BatchScanner scanner;
+	scanner.setThreadCount(threadCount(arguments));
+	if(takeFlag(arguments, "--csv"))
+		scanner.setOutputFormat(BatchScanner::Csv);
+	if(arguments.count() < 1 || arguments.count() > 2)
+		return usage();
+
+	QFile output;
+	bool opened;
+	if(arguments.count() == 2)
+	{
+		output.setFileName(arguments[1]);
+		opened = output.open(QIODevice::WriteOnly | QIODevice::Truncate);
+	}
+	else
+		opened = output.open(stdout, QIODevice::WriteOnly);
+	if(!opened)
+	{
+		err << output.errorString() << '\n';
+		return 1;
+	}
+
+	bool success = scanner.run(arguments[0], &output);
+	output.close();
+
+	// The summary goes to stderr, stdout may be the inventory itself.
+	QStringList errors = scanner.errors();
+	for(QStringList::const_iterator error = errors.constBegin(); error != errors.constEnd(); ++error)
+		err << *error << '\n';
+	err << scanner.summary() << '\n';
+	err.flush();
+
+	return success ? 0 : 1;
+}
+
+static int serveCommand(QStringList arguments)
+{
+	int threads = threadCount(arguments);
+	if(arguments.count() != 1)
+		return usage();
+
+	ConversionServer server(threads);
+	if(!server.listen(arguments[0]))
+	{
+		err << server.errorString() << '\n';
+		return 1;
+	}
+
+	err << "Listening on " << arguments[0] << '\n';
+	err.flush();
+	return QCoreApplication::exec();
+}
+
+static int clientCommand(QStringList arguments)
+{
+	if(arguments.count() < 2)
+		return usage();
+
+	QList<QStringList> requests;
+	QString name = arguments.takeFirst();
+	if(arguments.count() == 1 && arguments[0] == "-")
+	{
+		QTextStream in(stdin);
+		while(!in.atEnd())
+		{
+			QString line = in.readLine();
+			if(!line.trimmed().isEmpty())
+				requests.append(line.split('\t'));
+		}
+	}
+	else
+		requests.append(arguments);
+
+	// The server doesn't know our working directory.
+	for(QList<QStringList>::iterator request = requests.begin(); request != requests.end(); ++request)
+	{
+		int paths = ConversionServer::pathArguments(request->first());
+		for(int i = 1; i < request->count() && i <= paths; i++)
+			(*request)[i] = QFileInfo((*request)[i]).absoluteFilePath();
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	QLocalSocket socket;
+	socket.connectToServer(name);
+	if(!socket.waitForConnected(5000))
+	{
+		err << name << ": " << socket.errorString() << '\n';
+		return 1;
+	}
+
+	// All the requests go out at once, the server works on them in parallel.
+	for(int i = 0; i < requests.count(); i++)
+		socket.write(ConversionServer::request(i, requests[i].first(), requests[i].mid(1)));
+	socket.flush();
+
+	QVector<bool> answered(requests.count(), false);
+	QVector<bool> successes(requests.count(), false);
+	QVector<QString> results(requests.count());
+	int remaining = requests.count();
+	QByteArray buffer;
+	while(remaining > 0)
+	{
+		if(!socket.bytesAvailable() && !socket.waitForReadyRead(-1))
+			break;
+		buffer.append(socket.readAll());
+
+		QByteArray payload;
+		while(ConversionServer::takeFrame(buffer, payload))
+		{
+			quint32 id;
+			bool success;
+			QString result;
+			if(!ConversionServer::readResponse(payload, id, success, result) || id >= (quint32)requests.count() || answered[id])
+				continue;
+			answered[id] = true;
+			successes[id] = success;
+			results[id] = result;
+			remaining--;
+		}
+	}
+
+	int failed = 0;
+	for(int i = 0; i < requests.count(); i++)
+	{
+		if(!answered[i])
+			err << requests[i].join(" ") << ": " << socket.errorString() << '\n';
+		else if(!successes[i])
+			err << requests[i].join(" ") << ": " << results[i] << '\n';
+		else if(!results[i].isEmpty())
+			out << results[i] << '\n';
+		if(!answered[i] || !successes[i])
+			failed++;
+	}
+	out.flush();
+	err << QString("%1 requests in %2 ms, %3 failed").arg(requests.count()).arg(timer.elapsed()).arg(failed) << '\n';
+	err.flush();
+
+	return failed == 0 ? 0 : 1;
+}
+
+static int generateCommand(QStringList arguments)
+{
+	PapaGenerator::corpusspec_t corpus = PapaGenerator::defaultCorpus();
+	QString value;
+	if(takeOption(arguments, "--count", value))
+		corpus.Count = value.toInt();
+	if(takeOption(arguments, "--formats", value) && !PapaGenerator::parseWeights(value, true, corpus.Formats))
+		return usage();
+	if(takeOption(arguments, "--sizes", value) && !PapaGenerator::parseWeights(value, false, corpus.Sizes))
+		return usage();
+	if(takeOption(arguments, "--seed", value))
+		corpus.Seed = value.toUInt();
+	if(takeOption(arguments, "--non-square", value))
+		corpus.NonSquare = value.toDouble();
+	if(takeOption(arguments, "--bones", value))
+		corpus.MaxBones = value.toInt();
+	if(takeOption(arguments, "--sections", value))
+		corpus.Sections = value.toDouble();
+	if(arguments.count() != 1 || corpus.Count < 0)
+		return usage();
+
+	QElapsedTimer timer;
+	timer.start();
+	QStringList filenames;
+	QString error;
+	bool success = PapaGenerator::writeCorpus(arguments[0], corpus, filenames, error);
+	if(!success)
+		err << error << '\n';
+
+	qint64 bytes = 0;
+	for(QStringList::const_iterator filename = filenames.constBegin(); filename != filenames.constEnd(); ++filename)
+		bytes += QFileInfo(*filename).size();
+	err << QString("Wrote %1 files, %2 MB in %3 s").arg(filenames.count()).arg(bytes / (1024. * 1024.), 0, 'f', 1).arg(timer.elapsed() / 1000., 0, 'f', 2) << '\n';
+	err.flush();
+
+	return success ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	// No QApplication, so this runs without a display.
+	QCoreApplication app(argc, argv);
+
+	QStringList arguments = app.arguments();
+	arguments.removeFirst();
+
+	// Anywhere in the arguments, for every command.
+	bool stats = takeFlag(arguments, "--stats");
+	PapaStats::setEnabled(stats);
+	QString tracefile;
+	if(takeOption(arguments, "--trace", tracefile))
+		PapaTrace::start();
+	if(arguments.isEmpty())
+		return usage();
+
+	int result;
+	QString command = arguments.takeFirst();
+	if(command == "export")
+		result = exportCommand(arguments);
+	else if(command == "import")
+		result = importCommand(arguments, false);
+	else if(command == "build")
+		result = importCommand(arguments, true);
+	else if(command == "scan")
+		result = scanCommand(arguments);
+	else if(command == "serve")
+		result = serveCommand(arguments);
+	else if(command == "client")
+		result = clientCommand(arguments);
+	else if(command == "generate")
+		result = generateCommand(arguments);
+	else
+		return usage();
+
+	if(stats)
+	{
+		err << PapaStats::report(PapaStats::global().values()) << '\n';
+		err.flush();
+	}
+	QString error;
+	if(!tracefile.isEmpty() && !PapaTrace::write(tracefile, error))
+	{
+		err << tracefile << ": " << error << '\n';
+		err.flush();
+		return 1;
+	}
+	return result;
+}
@@ -0,0 +1,171 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "papatrace.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+struct event_t
+{
+	const char *Name;
+	QString Detail;
+	int Thread;
+	qint64 Start;
+	qint64 Duration;
+};
+
+// A long session shouldn't eat all the memory, the start of it is
+// usually what matters anyway.
+static const int MaximumEvents = 2000000;
+
+static QMutex Mutex;
+static QElapsedTimer Clock;
+static QList<event_t> Events;
+static int Dropped = 0;
+static QHash<Qt::HANDLE, int> Threads; // Numbered in the order they show up
+static QHash<int, QString> ThreadNames;
+
+static int threadNumber()
+{
+	// Only called with the mutex held.
+	Qt::HANDLE id = QThread::currentThreadId();
+	QHash<Qt::HANDLE, int>::const_iterator thread = Threads.constFind(id);
+	if(thread != Threads.constEnd())
+		return thread.value();
+
+	int number = Threads.count() + 1;
+	Threads.insert(id, number);
+	return number;
+}
+
+static QString json(const QString& text)
+{
+	QString escaped;
+	escaped.reserve(text.length() + 2);
+	escaped += '"';
+	for(int i = 0; i < text.length(); i++)
+	{
+		QChar c = text[i];
+		if(c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if(c.unicode() < 0x20)
+			escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+		else
+			escaped += c;
+	}
+	escaped += '"';
+	return escaped;
+}
+
+bool PapaTrace::Enabled = false;
+
+void PapaTrace::start()
+{
+	// The thread that starts the trace is taken to be the main one.
+	QMutexLocker locker(&Mutex);
+	Events.clear();
+	Dropped = 0;
+	Clock.start();
+	ThreadNames.insert(threadNumber(), "main");
+	Enabled = true;
+}
+
+void PapaTrace::setThreadName(const QString& name)
+{
+	if(!Enabled)
+		return;
+
+	QMutexLocker locker(&Mutex);
+	ThreadNames.insert(threadNumber(), name);
+}
+
+qint64 PapaTrace::now()
+{
+	return Clock.nsecsElapsed() / 1000;
+}
+
+void PapaTrace::record(const char *name, const QString& detail, qint64 start, qint64 duration)
+{
+	QMutexLocker locker(&Mutex);
+	if(Events.count() >= MaximumEvents)
+	{
+		Dropped++;
+		return;
+	}
+
+	event_t event;
+	event.Name = name;
+	event.Detail = detail;
+	event.Thread = threadNumber();
+	event.Start = start;
+	event.Duration = duration;
+	Events.append(event);
+}
+
+bool PapaTrace::write(const QString& filename, QString& error)
+{
+	QMutexLocker locker(&Mutex);
+	QFile file(filename);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		error = file.errorString();
+		return false;
+	}
+
+	// Complete events, one per span, plus the names of the threads.
+	QStringList entries;
+	for(QHash<Qt::HANDLE, int>::const_iterator thread = Threads.constBegin(); thread != Threads.constEnd(); ++thread)
+	{
+		QString name = ThreadNames.value(thread.value(), QString("thread %1").arg(thread.value()));
+		entries.append(QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%1,\"args\":{\"name\":%2}}").arg(thread.value()).arg(json(name)));
+		entries.append(QString("{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%1,\"args\":{\"sort_index\":%1}}").arg(thread.value()));
+	}
+	for(QList<event_t>::const_iterator event = Events.constBegin(); event != Events.constEnd(); ++event)
+	{
+		QString entry = QString("{\"name\":\"%1\",\"cat\":\"papa\",\"ph\":\"X\",\"pid\":1,\"tid\":%2,\"ts\":%3,\"dur\":%4")
+			.arg(event->Name)
+			.arg(event->Thread)
+			.arg(event->Start)
+			.arg(event->Duration);
+		if(!event->Detail.isEmpty())
+			entry += ",\"args\":{\"detail\":" + json(event->Detail) + '}';
+		entries.append(entry + '}');
+	}
+
+	QTextStream stream(&file);
+	stream << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << Dropped << "},\"traceEvents\":[\n";
+	stream << entries.join(",\n") << "\n]}\n";
+	stream.flush();
+	if(file.error() != QFile::NoError)
+	{
+		error = file.errorString();
+		return false;
+	}
+	return true;
+}
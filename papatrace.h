@@ -0,0 +1,57 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PAPATRACE_H
+#define PAPATRACE_H
+
+#include <QString>
+
+// Records a timeline of spans of work per thread, written as Chrome trace
+// event JSON that Perfetto and about:tracing open. Nothing is recorded
+// until start is called, until then a span is the check of one flag.
+class PapaTrace
+{
+public:
+	// Covers the time until it goes out of scope. The name has to be a
+	// string literal, the detail shows up as an argument of the span.
+	class Span
+	{
+	public:
+		Span(const char *name, const QString& detail = QString()) : Name(Enabled ? name : NULL), Start(0) {if(Name) {Detail = detail; Start = now();}}
+		~Span() {if(Name) record(Name, Detail, Start, now() - Start);}
+
+	private:
+		const char *Name;
+		QString Detail;
+		qint64 Start;
+	};
+
+	static void start();
+	static bool enabled() {return Enabled;}
+	static void setThreadName(const QString& name);
+	static bool write(const QString& filename, QString& error);
+
+private:
+	static qint64 now(); // Microseconds since start
+	static void record(const char *name, const QString& detail, qint64 start, qint64 duration);
+
+	static bool Enabled;
+};
+
+#endif // PAPATRACE_H
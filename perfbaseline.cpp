@@ -0,0 +1,203 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "perfbaseline.h"
+#include <QFile>
+#include <QTextStream>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+void PerfBaseline::add(const QString& name, double value, bool higherisbetter)
+{
+	metric_t metric;
+	metric.Value = value;
+	metric.HigherIsBetter = higherisbetter;
+	metric.Tolerance = -1;
+	Metrics.insert(name, metric);
+}
+
+bool PerfBaseline::load(const QString& filename, QString& error)
+{
+	QFile file(filename);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		error = QString("%1: %2").arg(filename).arg(file.errorString());
+		return false;
+	}
+
+	QTextStream stream(&file);
+	int linenumber = 0;
+	while(!stream.atEnd())
+	{
+		QString line = stream.readLine();
+		linenumber++;
+		if(line.trimmed().isEmpty() || line.trimmed().startsWith('#'))
+			continue;
+
+		QStringList fields = line.split('\t');
+		bool ok = (fields.count() == 3 || fields.count() == 4) && (fields[2] == "higher" || fields[2] == "lower");
+		metric_t metric;
+		metric.Value = ok ? fields[1].toDouble(&ok) : 0;
+		metric.HigherIsBetter = (ok && fields[2] == "higher");
+		metric.Tolerance = (ok && fields.count() == 4) ? fields[3].toDouble(&ok) : -1;
+		if(!ok)
+		{
+			error = QString("%1:%2: expected name, value, higher or lower and an optional tolerance, separated by tabs").arg(filename).arg(linenumber);
+			return false;
+		}
+
+		Metrics.insert(fields[0], metric);
+	}
+
+	return true;
+}
+
+bool PerfBaseline::save(const QString& filename, QString& error)
+{
+	// Keeps the comments and the tolerances of the old file.
+	QStringList header;
+	PerfBaseline old;
+	QFile oldfile(filename);
+	if(oldfile.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		QTextStream stream(&oldfile);
+		while(!stream.atEnd())
+		{
+			QString line = stream.readLine();
+			if(line.startsWith('#'))
+				header.append(line);
+		}
+		oldfile.close();
+
+		QString ignored;
+		old.load(filename, ignored);
+	}
+
+	QFile file(filename);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		error = QString("%1: %2").arg(filename).arg(file.errorString());
+		return false;
+	}
+
+	QTextStream stream(&file);
+	for(QStringList::const_iterator line = header.constBegin(); line != header.constEnd(); ++line)
+		stream << *line << '\n';
+	for(QMap<QString, metric_t>::const_iterator metric = Metrics.constBegin(); metric != Metrics.constEnd(); ++metric)
+	{
+		stream << metric.key() << '\t' << QString::number(metric->Value, 'g', 6) << '\t' << (metric->HigherIsBetter ? "higher" : "lower");
+		if(old.Metrics.contains(metric.key()) && old.Metrics[metric.key()].Tolerance >= 0)
+			stream << '\t' << old.Metrics[metric.key()].Tolerance;
+		stream << '\n';
+	}
+
+	return true;
+}
+
+QStringList PerfBaseline::compare(const PerfBaseline& baseline, double tolerance, bool& regressed)
+{
+	QStringList lines;
+	regressed = false;
+	for(QMap<QString, metric_t>::const_iterator metric = Metrics.constBegin(); metric != Metrics.constEnd(); ++metric)
+	{
+		QMap<QString, metric_t>::const_iterator reference = baseline.Metrics.constFind(metric.key());
+		if(reference == baseline.Metrics.constEnd())
+		{
+			lines.append(QString("%1: %2, no baseline").arg(metric.key()).arg(metric->Value, 0, 'g', 6));
+			continue;
+		}
+
+		// Positive is better, whichever direction that is for this metric.
+		double change = 0;
+		if(reference->Value != 0)
+			change = 100. * (metric->Value - reference->Value) / reference->Value;
+		if(!reference->HigherIsBetter)
+			change = -change;
+
+		double allowed = (reference->Tolerance >= 0) ? reference->Tolerance : tolerance;
+		bool worse = (change < -allowed);
+		regressed |= worse;
+		lines.append(QString("%1: %2, baseline %3, %4% %5%6")
+			.arg(metric.key())
+			.arg(metric->Value, 0, 'g', 6)
+			.arg(reference->Value, 0, 'g', 6)
+			.arg(qAbs(change), 0, 'f', 1)
+			.arg(change >= 0 ? "better" : "worse")
+			.arg(worse ? QString(", REGRESSED by more than %1%").arg(allowed) : QString()));
+	}
+
+	for(QMap<QString, metric_t>::const_iterator reference = baseline.Metrics.constBegin(); reference != baseline.Metrics.constEnd(); ++reference)
+	{
+		if(!Metrics.contains(reference.key()))
+			lines.append(QString("%1: not measured").arg(reference.key()));
+	}
+
+	return lines;
+}
+
+bool PerfBaseline::check(const QString& filename, double tolerance, bool update, QStringList& report)
+{
+	QString error;
+	if(update)
+	{
+		if(!save(filename, error))
+		{
+			report.append(error);
+			return false;
+		}
+		report.append(QString("Updated %1").arg(filename));
+		return true;
+	}
+
+	if(!QFile::exists(filename))
+	{
+		report.append(QString("%1 doesn't exist, nothing to compare with").arg(filename));
+		return true;
+	}
+
+	PerfBaseline baseline;
+	if(!baseline.load(filename, error))
+	{
+		report.append(error);
+		return false;
+	}
+
+	bool regressed;
+	report += compare(baseline, tolerance, regressed);
+	return !regressed;
+}
+
+qint64 PerfBaseline::peakResidentKb()
+{
+	// -1 where we don't know how to ask.
+#if defined(Q_OS_UNIX)
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+#if defined(Q_OS_MAC)
+	return usage.ru_maxrss / 1024; // Bytes there
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return -1;
+#endif
+}
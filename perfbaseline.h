@@ -0,0 +1,61 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PERFBASELINE_H
+#define PERFBASELINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+
+// Named benchmark numbers, saved as text so a change to the reference
+// numbers shows up in a diff. One "name<tab>value<tab>higher|lower" line
+// per metric, optionally followed by a tolerance in percent that overrides
+// the one given to compare.
+class PerfBaseline
+{
+public:
+	void add(const QString& name, double value, bool higherisbetter);
+	bool load(const QString& filename, QString& error);
+	bool save(const QString& filename, QString& error);
+
+	// Lists every metric against the baseline, and sets regressed if one
+	// got worse by more than the tolerance. Metrics missing from either side
+	// are reported but don't fail.
+	QStringList compare(const PerfBaseline& baseline, double tolerance, bool& regressed);
+
+	// What the benchmarks do with --baseline: compare against the file, or
+	// replace its numbers with these if update is set. False on a regression
+	// or an unreadable file, a missing one only gets a note.
+	bool check(const QString& filename, double tolerance, bool update, QStringList& report);
+
+	static qint64 peakResidentKb();
+
+private:
+	struct metric_t
+	{
+		double Value;
+		bool HigherIsBetter;
+		double Tolerance; // Percent, negative to use the default
+	};
+
+	QMap<QString, metric_t> Metrics;
+};
+
+#endif // PERFBASELINE_H
@@ -0,0 +1,194 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pipeline.h"
+#include "batchcommand.h"
+#include "papafile.h"
+#include <QThread>
+#include <QElapsedTimer>
+#include <QStringList>
+#include "papatrace.h"
+#include <algorithm>
+
+static const char *StageNames[Pipeline::StageCount] = {"read", "decode", "transform", "encode", "write"};
+static const char *StageSpans[Pipeline::StageCount] = {"read item", "decode item", "transform item", "encode item", "write item"}; // For the trace
+
+class PipelineThread : public QThread
+{
+public:
+	PipelineThread(Pipeline *pipeline, int stage)
+	 : Owner(pipeline), Stage(stage)
+	{
+	}
+
+protected:
+	virtual void run()
+	{
+		PapaTrace::setThreadName(QString("%1 stage").arg(StageNames[Stage]));
+		Owner->work(Stage);
+	}
+
+private:
+	Pipeline *Owner;
+	int Stage;
+};
+
+Pipeline::Pipeline(BatchCommand* command)
+ : Command(command), NextIndex(0), Count(0), Elapsed(0)
+{
+	for(int s = 0; s < StageCount; s++)
+	{
+		Stats[s].Threads = std::max(1, Command->stageThreads(s));
+		Stats[s].Items = 0;
+		Stats[s].Busy = 0;
+		Stats[s].Starved = 0;
+		Stats[s].Blocked = 0;
+
+		// Small queues are what keeps the memory use down, a couple of
+		// items per consumer is enough to smooth out the hiccups.
+		Queues[s] = (s == Read) ? NULL : new BoundedQueue<batchitem_t *>(2 * Stats[s].Threads);
+	}
+}
+
+Pipeline::~Pipeline()
+{
+	for(int s = 0; s < StageCount; s++)
+		delete Queues[s];
+}
+
+void Pipeline::run(int count)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	Count = count;
+	QList<QThread *> threads;
+	for(int s = 0; s < StageCount; s++)
+	{
+		Running[s] = Stats[s].Threads;
+		for(int i = 0; i < Stats[s].Threads; i++)
+			threads.append(new PipelineThread(this, s));
+	}
+	for(QList<QThread *>::iterator thread = threads.begin(); thread != threads.end(); ++thread)
+		(*thread)->start();
+	for(QList<QThread *>::iterator thread = threads.begin(); thread != threads.end(); ++thread)
+	{
+		(*thread)->wait();
+		delete (*thread);
+	}
+
+	Elapsed = timer.nsecsElapsed();
+}
+
+void Pipeline::work(int stage)
+{
+	QElapsedTimer timer;
+	timer.start();
+	stagestats_t stats = {0, 0, 0, 0, 0};
+
+	for(;;)
+	{
+		qint64 started = timer.nsecsElapsed();
+		batchitem_t *item = NULL;
+		if(stage == Read)
+		{
+			int index = NextIndex.fetchAndAddOrdered(1);
+			if(index >= Count)
+				break;
+			item = new batchitem_t;
+			item->Index = index;
+			item->Papa = NULL;
+			item->EncodeTime = 0;
+		}
+		else if(!Queues[stage]->pop(item))
+			break;
+
+		qint64 popped = timer.nsecsElapsed();
+		bool success = false;
+		{
+			PapaTrace::Span span(StageSpans[stage], PapaTrace::enabled() ? QString("item %1").arg(item->Index) : QString());
+			switch(stage)
+			{
+				case Read:
+					success = Command->read(item);
+					break;
+				case Decode:
+					success = Command->decode(item);
+					break;
+				case Transform:
+					success = Command->transform(item);
+					break;
+				case Encode:
+					success = Command->encode(item);
+					break;
+				case Write:
+					success = Command->write(item);
+					break;
+			}
+		}
+		qint64 done = timer.nsecsElapsed();
+
+		// Failures are recorded by the command, the item just stops here.
+		if(success && stage + 1 < StageCount)
+			Queues[stage + 1]->push(item);
+		else
+		{
+			delete item->Papa;
+			delete item;
+		}
+
+		stats.Items++;
+		stats.Starved += popped - started;
+		stats.Busy += done - popped;
+		stats.Blocked += timer.nsecsElapsed() - done;
+	}
+
+	// The last one out tells the next stage nothing else is coming.
+	if(!Running[stage].deref() && stage + 1 < StageCount)
+		Queues[stage + 1]->close();
+
+	QMutexLocker locker(&Mutex);
+	Stats[stage].Items += stats.Items;
+	Stats[stage].Busy += stats.Busy;
+	Stats[stage].Starved += stats.Starved;
+	Stats[stage].Blocked += stats.Blocked;
+}
+
+QString Pipeline::utilisation()
+{
+	// Busy is doing the work, starved is waiting for the previous stage and
+	// blocked is waiting for room in the next one. A busy stage that blocks
+	// nothing but starves the rest is the bottleneck.
+
+	QStringList lines;
+	double total = std::max(Elapsed, (qint64)1);
+	for(int s = 0; s < StageCount; s++)
+	{
+		double available = total * Stats[s].Threads;
+		lines.append(QString("%1: %2 items, %3 threads, %4% busy, %5% starved, %6% blocked")
+			.arg(StageNames[s], -9)
+			.arg(Stats[s].Items)
+			.arg(Stats[s].Threads)
+			.arg(100. * Stats[s].Busy / available, 0, 'f', 1)
+			.arg(100. * Stats[s].Starved / available, 0, 'f', 1)
+			.arg(100. * Stats[s].Blocked / available, 0, 'f', 1));
+	}
+
+	return lines.join("\n");
+}
@@ -0,0 +1,133 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QList>
+#include <QImage>
+#include <QByteArray>
+#include <QStringList>
+#include <QAtomicInt>
+
+class PapaFile;
+class BatchCommand;
+
+// One file on its way through the pipeline. Which fields get used depends
+// on the command.
+struct batchitem_t
+{
+	int Index;
+	PapaFile *Papa;
+	QByteArray Input;
+	QList<QImage> Images;
+	QStringList OutputNames;
+	QList<QByteArray> Outputs;
+	qint64 EncodeTime; // Milliseconds
+	QByteArray InputHash;
+};
+
+// Blocks the producer when full and the consumer when empty. Once closed,
+// pop returns false as soon as it runs empty.
+template <typename T>
+class BoundedQueue
+{
+public:
+	BoundedQueue(int capacity) : Capacity(capacity), Closed(false) {}
+
+	void push(const T& value)
+	{
+		QMutexLocker locker(&Mutex);
+		while(Items.count() >= Capacity)
+			NotFull.wait(&Mutex);
+		Items.enqueue(value);
+		NotEmpty.wakeOne();
+	}
+
+	bool pop(T& value)
+	{
+		QMutexLocker locker(&Mutex);
+		while(Items.isEmpty() && !Closed)
+			NotEmpty.wait(&Mutex);
+		if(Items.isEmpty())
+			return false;
+		value = Items.dequeue();
+		NotFull.wakeOne();
+		return true;
+	}
+
+	void close()
+	{
+		QMutexLocker locker(&Mutex);
+		Closed = true;
+		NotEmpty.wakeAll();
+	}
+
+private:
+	QMutex Mutex;
+	QWaitCondition NotEmpty;
+	QWaitCondition NotFull;
+	QQueue<T> Items;
+	int Capacity;
+	bool Closed;
+};
+
+class Pipeline
+{
+public:
+	enum Stage
+	{
+		Read,
+		Decode,
+		Transform,
+		Encode,
+		Write,
+		StageCount
+	};
+
+	Pipeline(BatchCommand *command);
+	~Pipeline();
+	void run(int count);
+	QString utilisation();
+	void work(int stage);
+
+private:
+	struct stagestats_t
+	{
+		int Threads;
+		int Items;
+		qint64 Busy; // Nanoseconds, summed over the threads of the stage
+		qint64 Starved;
+		qint64 Blocked;
+	};
+
+	BatchCommand *Command;
+	BoundedQueue<batchitem_t *> *Queues[StageCount]; // Queues[s] feeds stage s, Queues[Read] isn't used
+	QAtomicInt NextIndex;
+	int Count;
+	QAtomicInt Running[StageCount];
+	QMutex Mutex;
+	stagestats_t Stats[StageCount];
+	qint64 Elapsed;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,123 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "prefetcher.h"
+#include "papafile.h"
+#include "taskscheduler.h"
+#include <QRunnable>
+
+class PrefetchJob : public QRunnable
+{
+public:
+	PrefetchJob(Prefetcher *prefetcher, int generation, QSharedPointer<PapaFile> papa)
+	 : Owner(prefetcher), Generation(generation), Papa(papa)
+	{
+	}
+
+	virtual void run()
+	{
+		// Same order as the viewer asks for them, so a half finished
+		// prefetch still helps.
+		for(int m = Papa->mipCount(0) - 1; m >= 0; m--)
+		{
+			if(!Owner->isCurrent(Generation))
+				return;
+
+			Papa->mipmap(0, m, true);
+		}
+	}
+
+private:
+	Prefetcher *Owner;
+	int Generation;
+	QSharedPointer<PapaFile> Papa;
+};
+
+Prefetcher::Prefetcher(TaskScheduler *scheduler, qint64 budget, QObject* parent)
+ : QObject(parent), Generation(0), Scheduler(scheduler), Budget(budget)
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+	clear();
+	Scheduler->waitForDone(this);
+}
+
+qint64 Prefetcher::decodedSize(PapaFile *papa)
+{
+	qint64 bytes = 0;
+	for(int m = 0; m < papa->mipCount(0); m++)
+		bytes += 4 * papa->size(0, m).width() * papa->size(0, m).height();
+
+	return bytes;
+}
+
+void Prefetcher::prefetch(QSharedPointer<PapaFile> current, const QList<QSharedPointer<PapaFile> >& neighbours)
+{
+	Generation.ref();
+	Scheduler->cancel(this);
+
+	// The neighbours come nearest first, so the ones that don't fit in the
+	// budget are the least likely to be looked at next.
+	QList<QSharedPointer<PapaFile> > keep;
+	qint64 bytes = 0;
+	if(current)
+	{
+		keep.append(current);
+		bytes += decodedSize(current.data());
+	}
+	for(QList<QSharedPointer<PapaFile> >::const_iterator papa = neighbours.constBegin(); papa != neighbours.constEnd(); ++papa)
+	{
+		bytes += decodedSize(papa->data());
+		if(bytes > Budget)
+			break;
+		keep.append(*papa);
+	}
+
+	release(keep);
+	Resident = keep;
+
+	for(int i = current ? 1 : 0; i < keep.count(); i++)
+		Scheduler->start(new PrefetchJob(this, Generation, keep[i]), TaskScheduler::Prefetch, this);
+}
+
+void Prefetcher::clear()
+{
+	Generation.ref();
+	Scheduler->cancel(this);
+	release(QList<QSharedPointer<PapaFile> >());
+	Resident.clear();
+}
+
+void Prefetcher::release(const QList<QSharedPointer<PapaFile> >& keep)
+{
+	// Whatever left the neighbourhood goes back to being read from disk. A
+	// file that some job is busy with can't be released right now, it is
+	// tried again on the next call instead of staying in memory for good.
+	QList<QSharedPointer<PapaFile> > leaving = Resident + Unreleased;
+	Unreleased.clear();
+	for(QList<QSharedPointer<PapaFile> >::const_iterator papa = leaving.constBegin(); papa != leaving.constEnd(); ++papa)
+	{
+		if(!keep.contains(*papa) && !Unreleased.contains(*papa) && !(*papa)->release())
+			Unreleased.append(*papa);
+	}
+}
+
+#include "prefetcher.moc"
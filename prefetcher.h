@@ -0,0 +1,52 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+class PapaFile;
+class TaskScheduler;
+
+class Prefetcher : public QObject
+{
+	Q_OBJECT
+
+public:
+	Prefetcher(TaskScheduler *scheduler, qint64 budget, QObject *parent = 0);
+	~Prefetcher();
+	void prefetch(QSharedPointer<PapaFile> current, const QList<QSharedPointer<PapaFile> >& neighbours);
+	void clear();
+	bool isCurrent(int generation) {return Generation == generation;}
+	static qint64 decodedSize(PapaFile *papa);
+
+private:
+	void release(const QList<QSharedPointer<PapaFile> >& keep);
+
+	QAtomicInt Generation;
+	TaskScheduler *Scheduler;
+	qint64 Budget;
+	QList<QSharedPointer<PapaFile> > Resident;
+	QList<QSharedPointer<PapaFile> > Unreleased; // Were busy, tried again next time
+};
+
+#endif // PREFETCHER_H
@@ -0,0 +1,238 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "taskscheduler.h"
+#include <QRunnable>
+#include <QThread>
+#include <QStringList>
+#include "papatrace.h"
+#include <algorithm>
+
+static const char *PriorityNames[TaskScheduler::PriorityCount] = {"selection", "edit", "thumbnail", "prefetch", "indexing"};
+static const char *PrioritySpans[TaskScheduler::PriorityCount] = {"selection job", "edit job", "thumbnail job", "prefetch job", "indexing job"}; // For the trace
+
+class SchedulerThread : public QThread
+{
+public:
+	SchedulerThread(TaskScheduler *scheduler, bool reserved)
+	 : Scheduler(scheduler), Reserved(reserved)
+	{
+	}
+
+protected:
+	virtual void run()
+	{
+		PapaTrace::setThreadName(Reserved ? "selection worker" : "worker");
+		Scheduler->work(Reserved);
+	}
+
+private:
+	TaskScheduler *Scheduler;
+	bool Reserved;
+};
+
+TaskScheduler::TaskScheduler(int threadcount, QObject* parent)
+ : QObject(parent), Stopping(false)
+{
+	for(int p = 0; p < PriorityCount; p++)
+	{
+		Counters[p].Queued = 0;
+		Counters[p].Running = 0;
+		Counters[p].Finished = 0;
+		Counters[p].Cancelled = 0;
+		Counters[p].WaitTime = 0;
+		Counters[p].MaximumWaitTime = 0;
+		Counters[p].RunTime = 0;
+	}
+	Clock.start();
+
+	// The first worker only ever runs Selection jobs, so whatever the user
+	// clicked on never waits for a directory full of thumbnails. There is
+	// always at least one more, or nothing else would ever run.
+	if(threadcount <= 0)
+		threadcount = QThread::idealThreadCount();
+	threadcount = std::max(2, threadcount);
+	for(int i = 0; i < threadcount; i++)
+	{
+		QThread *worker = new SchedulerThread(this, i == 0);
+		Workers.append(worker);
+		worker->start();
+	}
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	Mutex.lock();
+	Stopping = true;
+	for(int p = 0; p < PriorityCount; p++)
+	{
+		for(QList<job_t>::iterator job = Queues[p].begin(); job != Queues[p].end(); ++job)
+		{
+			if(job->Job->autoDelete())
+				delete job->Job;
+		}
+		Queues[p].clear();
+	}
+	WorkAvailable.wakeAll();
+	Mutex.unlock();
+
+	for(QList<QThread *>::iterator worker = Workers.begin(); worker != Workers.end(); ++worker)
+	{
+		(*worker)->wait();
+		delete (*worker);
+	}
+}
+
+void TaskScheduler::start(QRunnable* job, TaskScheduler::Priority priority, const void *owner, const void *key)
+{
+	QMutexLocker locker(&Mutex);
+
+	job_t queued;
+	queued.Job = job;
+	queued.Owner = owner;
+	queued.Key = key;
+	queued.QueuedAt = Clock.elapsed();
+	Queues[priority].append(queued);
+	Counters[priority].Queued++;
+
+	// Waking just one could pick the reserved worker for a job it won't take.
+	WorkAvailable.wakeAll();
+}
+
+int TaskScheduler::cancel(const void *owner, const void *key)
+{
+	// Jobs that are already running can't be stopped from here, their owner
+	// has to tell them.
+	QMutexLocker locker(&Mutex);
+
+	int cancelled = 0;
+	for(int p = 0; p < PriorityCount; p++)
+	{
+		QList<job_t>::iterator job = Queues[p].begin();
+		while(job != Queues[p].end())
+		{
+			if(job->Owner == owner && (key == NULL || job->Key == key))
+			{
+				if(job->Job->autoDelete())
+					delete job->Job;
+				job = Queues[p].erase(job);
+				Counters[p].Queued--;
+				Counters[p].Cancelled++;
+				cancelled++;
+			}
+			else
+				++job;
+		}
+	}
+
+	return cancelled;
+}
+
+void TaskScheduler::waitForDone(const void *owner)
+{
+	// Only waits for the running jobs, queued ones should be cancelled first.
+	QMutexLocker locker(&Mutex);
+	while(RunningJobs.value(owner) > 0)
+		JobDone.wait(&Mutex);
+}
+
+TaskScheduler::counters_t TaskScheduler::counters(TaskScheduler::Priority priority)
+{
+	QMutexLocker locker(&Mutex);
+	return Counters[priority];
+}
+
+QString TaskScheduler::report()
+{
+
+	QStringList lines;
+	for(int p = 0; p < PriorityCount; p++)
+	{
+		counters_t counters = this->counters((Priority)p);
+		lines.append(QString("%1: %2 queued, %3 running, %4 finished, %5 cancelled, average wait %6 ms (max %7 ms), average run %8 ms")
+			.arg(PriorityNames[p])
+			.arg(counters.Queued)
+			.arg(counters.Running)
+			.arg(counters.Finished)
+			.arg(counters.Cancelled)
+			.arg(counters.Finished > 0 ? counters.WaitTime / counters.Finished : 0)
+			.arg(counters.MaximumWaitTime)
+			.arg(counters.Finished > 0 ? counters.RunTime / counters.Finished : 0));
+	}
+
+	return lines.join("\n");
+}
+
+bool TaskScheduler::takeJob(bool reserved, job_t& job, int& priority)
+{
+	int last = reserved ? Selection : PriorityCount - 1;
+	for(int p = 0; p <= last; p++)
+	{
+		if(!Queues[p].isEmpty())
+		{
+			job = Queues[p].takeFirst();
+			priority = p;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void TaskScheduler::work(bool reserved)
+{
+	QMutexLocker locker(&Mutex);
+	for(;;)
+	{
+		job_t job;
+		int priority = 0;
+		while(!Stopping && !takeJob(reserved, job, priority))
+			WorkAvailable.wait(&Mutex);
+		if(Stopping)
+			return;
+
+		qint64 started = Clock.elapsed();
+		counters_t &counters = Counters[priority];
+		counters.Queued--;
+		counters.Running++;
+		counters.WaitTime += started - job.QueuedAt;
+		counters.MaximumWaitTime = std::max(counters.MaximumWaitTime, started - job.QueuedAt);
+		RunningJobs[job.Owner]++;
+		locker.unlock();
+
+		// Background work shouldn't compete with the GUI thread.
+		QThread::currentThread()->setPriority(priority >= Prefetch ? QThread::LowPriority : QThread::NormalPriority);
+		{
+			PapaTrace::Span span(PrioritySpans[priority], PapaTrace::enabled() ? QString("waited %1 ms").arg(started - job.QueuedAt) : QString());
+			job.Job->run();
+			if(job.Job->autoDelete())
+				delete job.Job;
+		}
+
+		locker.relock();
+		counters.Running--;
+		counters.Finished++;
+		counters.RunTime += Clock.elapsed() - started;
+		if(--RunningJobs[job.Owner] == 0)
+			RunningJobs.remove(job.Owner);
+		JobDone.wakeAll();
+	}
+}
+
+#include "taskscheduler.moc"
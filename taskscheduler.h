@@ -0,0 +1,94 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+class QRunnable;
+class QThread;
+
+class TaskScheduler : public QObject
+{
+	Q_OBJECT
+
+public:
+	// Highest priority first.
+	enum Priority
+	{
+		Selection,
+		Edit,
+		Thumbnail,
+		Prefetch,
+		Indexing,
+		PriorityCount
+	};
+
+	struct counters_t
+	{
+		int Queued;
+		int Running;
+		qint64 Finished;
+		qint64 Cancelled;
+		qint64 WaitTime; // Milliseconds, summed over all finished jobs
+		qint64 MaximumWaitTime;
+		qint64 RunTime;
+	};
+
+	TaskScheduler(int threadcount = 0, QObject *parent = 0);
+	~TaskScheduler();
+	void start(QRunnable *job, Priority priority, const void *owner, const void *key = NULL);
+	int cancel(const void *owner, const void *key = NULL);
+	void waitForDone(const void *owner);
+	int threadCount() {return Workers.count();}
+	counters_t counters(Priority priority);
+	QString report();
+
+private:
+	friend class SchedulerThread;
+
+	struct job_t
+	{
+		QRunnable *Job;
+		const void *Owner;
+		const void *Key;
+		qint64 QueuedAt;
+	};
+
+	void work(bool reserved);
+	bool takeJob(bool reserved, job_t& job, int& priority);
+
+	QMutex Mutex;
+	QWaitCondition WorkAvailable;
+	QWaitCondition JobDone;
+	QList<job_t> Queues[PriorityCount];
+	counters_t Counters[PriorityCount];
+	QHash<const void *, int> RunningJobs; // Per owner
+	QList<QThread *> Workers;
+	QElapsedTimer Clock;
+	bool Stopping;
+};
+
+#endif // TASKSCHEDULER_H
@@ -19,32 +19,141 @@
 
 #include "texturelistmodel.h"
 #include "papafileheader.h"
+#include "directoryscanner.h"
+#include "thumbnailloader.h"
+#include "prefetcher.h"
+#include "taskscheduler.h"
+#include "papatrace.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QDir>
 #include <QImageReader>
+#include <QImageWriter>
+#include <QRunnable>
 #include <QBrush>
 #include <QDebug>
+#include <algorithm>
 
 TextureListModel::TextureListModel(QObject* parent)
- : QAbstractListModel(parent), LastError("")
+ : QAbstractListModel(parent), LastError(""), Watching(false), Scanner(NULL), ShowThumbnails(false)
 {
+	// All the background work, including saving, importing and exporting,
+	// shares these threads.
+	Scheduler = new TaskScheduler(0, this);
+
+	// Enough for a few 2048x2048 textures either side of the selection.
+	Prefetch = new Prefetcher(Scheduler, 256 * 1024 * 1024, this);
+
+	// Thumbnails are charged in kilobytes.
+	Thumbnails.setMaxCost(64 * 1024);
+	Thumbnailer = new ThumbnailLoader(Scheduler, QSize(96, 96), this);
+	connect(Thumbnailer, SIGNAL(thumbnailReady(PapaFile *, const QString &, const QImage &)), SLOT(thumbnailReady(PapaFile *, const QString &, const QImage &)));
+
+	Watcher = new QFileSystemWatcher(this);
+	connect(Watcher, SIGNAL(directoryChanged(const QString &)), SLOT(directoryChanged(const QString &)));
 }
 
 TextureListModel::~TextureListModel()
 {
-	for(QList<PapaFile *>::iterator papa = Papas.begin(); papa != Papas.end(); ++papa)
-		delete (*papa);
+	delete Scanner;
+	delete Thumbnailer;
+	delete Prefetch;
+	Scheduler->waitForDone(this);
+	delete Scheduler;
 	Papas.clear();
 }
 
+// The background jobs may still hold on to a PapaFile after its row is gone,
+// so they are shared and deleted in the thread they belong to.
+static QSharedPointer<PapaFile> makeShared(PapaFile *papa)
+{
+	return QSharedPointer<PapaFile>(papa, &QObject::deleteLater);
+}
+
+class TaskJob : public QRunnable
+{
+public:
+	TaskJob(QObject *model, TextureListModel::Task task, QSharedPointer<PapaFile> papa, const QString& filename)
+	 : Model(model), Task(task), Papa(papa), Filename(filename)
+	{
+	}
+
+	virtual void run()
+	{
+		bool success = false;
+		QString error;
+		switch(Task)
+		{
+			case TextureListModel::SaveTask:
+				// Re-encoding an unchanged file would only lose quality.
+				success = (!Papa->isModified() && Filename == Papa->filename()) || Papa->write(Filename);
+				error = Papa->lastError();
+				break;
+			case TextureListModel::ImportTask:
+			{
+				QImageReader reader(Filename);
+				QImage image = reader.read();
+				if(image.isNull())
+					error = reader.errorString();
+				else if(image.size() != Papa->size(0))
+					error = "The import image must be the same resolution as the current texture.";
+				else
+				{
+					success = Papa->importImage(image, 0);
+					error = Papa->lastError();
+				}
+				break;
+			}
+			case TextureListModel::ExportTask:
+			{
+				QImage image = Papa->mipmap(0, 0);
+				if(image.isNull())
+				{
+					error = Papa->lastError();
+					break;
+				}
+				QImageWriter writer(Filename);
+				writer.setFormat(QFileInfo(Filename).suffix().toAscii());
+				success = writer.write(image);
+				error = writer.errorString();
+				break;
+			}
+		}
+
+		QMetaObject::invokeMethod(Model, "taskDone", Qt::QueuedConnection, Q_ARG(QObject *, Papa.data()), Q_ARG(int, Task), Q_ARG(QString, Filename), Q_ARG(bool, success), Q_ARG(QString, error));
+	}
+
+private:
+	QObject *Model;
+	TextureListModel::Task Task;
+	QSharedPointer<PapaFile> Papa;
+	QString Filename;
+};
+
 QVariant TextureListModel::data(const QModelIndex& index, int role) const
 {
 	switch(role)
 	{
 		case Qt::DisplayRole:
+			return QVariant(QDir(Folder).relativeFilePath(Papas.at(index.row())->filename()));
+		case Qt::ToolTipRole:
 			return QVariant(Papas.at(index.row())->name());
+		case Qt::DecorationRole:
+			if(ShowThumbnails)
+			{
+				// Only the rows that are on screen get asked for this, so
+				// that's what gets decoded.
+				QPixmap *thumbnail = Thumbnails.object(Papas.at(index.row()).data());
+				if(thumbnail)
+					return *thumbnail;
+				Thumbnailer->request(Papas.at(index.row()));
+			}
+			return QVariant();
 		case Qt::ForegroundRole:
-			if(Papas.at(index.row())->isModified())
+			if(Busy.contains(Papas.at(index.row()).data()))
+				return QBrush(Qt::gray);
+			else if(Papas.at(index.row())->isModified())
 				return QBrush(Qt::red);
 			else
 				return QVariant();
@@ -72,24 +181,295 @@ bool TextureListModel::loadFromDirectory(const QString& foldername)
 	if(!folder.exists())
 		return false;
 
-	for(QList<PapaFile *>::iterator papa = Papas.begin(); papa != Papas.end(); ++papa)
-		delete (*papa);
-	Papas.clear();
+	delete Scanner;
+	Scanner = NULL;
 
 	beginResetModel();
+	Prefetch->clear();
+	Thumbnailer->clear();
+	Thumbnails.clear();
+	Papas.clear();
+	Stamps.clear();
+	Directories.clear();
+	Folder = folder.absolutePath();
+	endResetModel();
+
+	updateWatcher();
+
+	// Walk the tree in the background, the rows are inserted as they are found.
+	Scanner = new DirectoryScanner(Scheduler, Folder, this);
+	connect(Scanner, SIGNAL(batchReady()), SLOT(scannerBatchReady()));
+	connect(Scanner, SIGNAL(finished()), SLOT(scannerFinished()));
+	Scanner->start();
+
+	return true;
+}
+
+void TextureListModel::scannerBatchReady()
+{
+	if(!Scanner)
+		return;
+
+	PapaTrace::Span span("insert scanned");
+	QList<PapaFile *> papas;
+	QStringList scanned, directories;
+	Scanner->takeBatch(papas, scanned, directories);
+
+	for(QStringList::const_iterator filename = scanned.constBegin(); filename != scanned.constEnd(); ++filename)
+		updateStamp(*filename);
+
+	Directories += directories;
+	if(Watching && !directories.isEmpty())
+		Watcher->addPaths(directories);
+
+	insertPapas(papas);
+}
+
+void TextureListModel::scannerFinished()
+{
+	// May come from a scanner that was replaced since. The last batch was
+	// signalled before this, but may not be taken yet.
+	if(!Scanner || sender() != Scanner)
+		return;
+	scannerBatchReady();
+	emit loadFinished();
+}
+
+void TextureListModel::setWatching(bool watch)
+{
+	Watching = watch;
+	updateWatcher();
+}
+
+void TextureListModel::updateWatcher()
+{
+	// Only the directories are watched, a watch per file would run out of
+	// inotify watches or kqueue file descriptors on a large tree. They
+	// report files that are added, removed or replaced, and a file that is
+	// rewritten in place is caught by its stamp the next time its directory
+	// changes.
+	if(!Watcher->directories().isEmpty())
+		Watcher->removePaths(Watcher->directories());
+
+	if(!Watching || Folder.isEmpty())
+		return;
+
+	if(!Directories.isEmpty())
+		Watcher->addPaths(Directories);
+}
+
+void TextureListModel::directoryChanged(const QString& foldername)
+{
+	QDir folder(foldername);
+	QString prefix = folder.absolutePath() + '/';
+
+	if(!folder.exists())
+		Directories.removeAll(folder.absolutePath());
+
+	// Drop the rows whose file has gone, unless they still hold unsaved changes.
+	for(int row = lowerBound(prefix); row < Papas.count() && Papas[row]->filename().startsWith(prefix); )
+	{
+		QString filename = Papas[row]->filename();
+		if(!QFileInfo(filename).exists() && !Papas[row]->isModified())
+		{
+			Stamps.remove(filename);
+			removePapa(row);
+		}
+		else
+			row++;
+	}
+
+	if(!folder.exists())
+		return;
+
+	// New subfolders have to be watched and scanned as well, but leave that
+	// to the scanner while it is still walking the tree.
+	QStringList subfolders = folder.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Readable, QDir::Name);
+	for(QStringList::const_iterator subfolder = subfolders.constBegin(); subfolder != subfolders.constEnd(); ++subfolder)
+	{
+		QString subfoldername = prefix + *subfolder;
+		if(!(Scanner && Scanner->isRunning()) && !Directories.contains(subfoldername))
+		{
+			Directories.push_back(subfoldername);
+			if(Watching)
+				Watcher->addPath(subfoldername);
+			directoryChanged(subfoldername);
+		}
+	}
+
+	// Pick up new files and reload the ones whose stamp changed. Files that
+	// were rejected before are remembered in Stamps, so they only get parsed
+	// again if they change.
 	QStringList papafiles = folder.entryList(QStringList("*.papa"), QDir::Files | QDir::Readable, QDir::Name);
 	for(QStringList::const_iterator papafile = papafiles.constBegin(); papafile != papafiles.constEnd(); ++papafile)
 	{
-		qDebug() << *papafile;
-		PapaFile *papa = new PapaFile(foldername + '/' + *papafile);
-		if(papa->isValid() && papa->textureCount() == 1)
-			Papas.push_back(papa);
+		QString filename = prefix + *papafile;
+		int row = findPapa(filename);
+		if(row >= 0)
+		{
+			if(isChangedOnDisk(filename))
+				reloadPapa(row);
+		}
+		else if(!Stamps.contains(filename) || isChangedOnDisk(filename))
+		{
+			updateStamp(filename);
+			PapaFile *papa = loadPapa(filename);
+			if(papa)
+				insertPapa(papa);
+		}
+	}
+}
+
+PapaFile *TextureListModel::loadPapa(const QString& filename)
+{
+	PapaFile *papa = new PapaFile(filename);
+	if(papa->isValid() && papa->textureCount() == 1)
+		return papa;
+
+	delete papa;
+	return NULL;
+}
+
+int TextureListModel::findPapa(const QString& filename)
+{
+	int row = lowerBound(filename);
+	if(row < Papas.count() && Papas[row]->filename() == filename)
+		return row;
+
+	return -1;
+}
+
+int TextureListModel::lowerBound(const QString& filename)
+{
+	// The rows are kept sorted by filename.
+	int first = 0, last = Papas.count();
+	while(first < last)
+	{
+		int middle = (first + last) / 2;
+		if(Papas[middle]->filename() < filename)
+			first = middle + 1;
 		else
-			delete papa;
+			last = middle;
 	}
-	endResetModel();
 
-	return true;
+	return first;
+}
+
+void TextureListModel::insertPapa(PapaFile *papa)
+{
+	int row = lowerBound(papa->filename());
+	if(row < Papas.count() && Papas[row]->filename() == papa->filename())
+	{
+		// Already picked up by the watcher while scanning.
+		delete papa;
+		return;
+	}
+
+	beginInsertRows(QModelIndex(), row, row);
+	Papas.insert(row, makeShared(papa));
+	endInsertRows();
+}
+
+static bool papaLessThan(PapaFile *papa1, PapaFile *papa2)
+{
+	return papa1->filename() < papa2->filename();
+}
+
+void TextureListModel::insertPapas(QList<PapaFile *> papas)
+{
+	if(papas.isEmpty())
+		return;
+
+	qSort(papas.begin(), papas.end(), papaLessThan);
+	if(!Papas.isEmpty() && papas.first()->filename() <= Papas.last()->filename())
+	{
+		for(QList<PapaFile *>::iterator papa = papas.begin(); papa != papas.end(); ++papa)
+			insertPapa(*papa);
+		return;
+	}
+
+	// The common case while scanning, everything goes at the end in one go.
+	beginInsertRows(QModelIndex(), Papas.count(), Papas.count() + papas.count() - 1);
+	for(QList<PapaFile *>::iterator papa = papas.begin(); papa != papas.end(); ++papa)
+		Papas.push_back(makeShared(*papa));
+	endInsertRows();
+}
+
+void TextureListModel::removePapa(int row)
+{
+	beginRemoveRows(QModelIndex(), row, row);
+	Thumbnailer->cancel(Papas[row].data());
+	Thumbnails.remove(Papas[row].data());
+	Papas.removeAt(row);
+	endRemoveRows();
+}
+
+void TextureListModel::reloadPapa(int row)
+{
+	QString filename = Papas[row]->filename();
+	// Unsaved edits win over the copy on disk, saving overwrites it anyway.
+	if(Papas[row]->isModified() || Busy.contains(Papas[row].data()))
+		return;
+
+	updateStamp(filename);
+	PapaFile *papa = loadPapa(filename);
+	if(papa)
+	{
+		Thumbnailer->cancel(Papas[row].data());
+		Thumbnails.remove(Papas[row].data());
+		Papas[row] = makeShared(papa);
+		emit dataChanged(index(row), index(row));
+		emit textureReplaced(index(row));
+	}
+	else
+		removePapa(row);
+}
+
+void TextureListModel::setThumbnails(bool show)
+{
+	ShowThumbnails = show;
+	if(!show)
+		Thumbnailer->clear();
+
+	if(Papas.count() > 0)
+		emit dataChanged(index(0), index(Papas.count() - 1));
+}
+
+QSize TextureListModel::thumbnailSize()
+{
+	return Thumbnailer->size();
+}
+
+void TextureListModel::thumbnailReady(PapaFile *papa, const QString& filename, const QImage& thumbnail)
+{
+	// The row may have gone or been reloaded in the meantime.
+	PapaTrace::Span span("show thumbnail");
+	int row = findPapa(filename);
+	if(row < 0 || Papas[row].data() != papa)
+		return;
+
+	// Failures are cached as well, so they aren't tried over and over.
+	Thumbnails.insert(papa, new QPixmap(QPixmap::fromImage(thumbnail)), std::max(1, thumbnail.byteCount() / 1024));
+	emit dataChanged(index(row), index(row));
+}
+
+bool TextureListModel::isChangedOnDisk(const QString& filename)
+{
+	if(!Stamps.contains(filename))
+		return true;
+
+	QFileInfo info(filename);
+	const filestamp_t &stamp = Stamps[filename];
+	return info.lastModified() != stamp.LastModified || info.size() != stamp.Size;
+}
+
+void TextureListModel::updateStamp(const QString& filename)
+{
+	QFileInfo info(filename);
+	filestamp_t stamp;
+	stamp.LastModified = info.lastModified();
+	stamp.Size = info.size();
+	Stamps[filename] = stamp;
 }
 
 
@@ -97,23 +477,55 @@ PapaFile *TextureListModel::papa(const QModelIndex& index)
 {
 	if(index.row() < Papas.count())
 	{
-		return Papas[index.row()];
+		return Papas[index.row()].data();
 	}
 	else
 		return NULL;
 }
 
+QSharedPointer<PapaFile> TextureListModel::sharedPapa(const QModelIndex& index)
+{
+	if(index.row() < Papas.count())
+		return Papas[index.row()];
+	else
+		return QSharedPointer<PapaFile>();
+}
+
+void TextureListModel::prefetch(const QModelIndex& index)
+{
+	if(!index.isValid() || index.row() >= Papas.count())
+	{
+		Prefetch->clear();
+		return;
+	}
+
+	// Nearest first, alternating between the rows below and above.
+	const int range = 3;
+	QList<QSharedPointer<PapaFile> > neighbours;
+	for(int distance = 1; distance <= range; distance++)
+	{
+		if(index.row() + distance < Papas.count())
+			neighbours.append(Papas[index.row() + distance]);
+		if(index.row() - distance >= 0)
+			neighbours.append(Papas[index.row() - distance]);
+	}
+
+	Prefetch->prefetch(Papas[index.row()], neighbours);
+}
+
 QString TextureListModel::info(const QModelIndex& index)
 {
 	if(index.row() < Papas.count())
 	{
+		// Comes straight from the header, so nothing needs decoding.
 		QString info;
-		PapaFile *papa = Papas[index.row()];
-		const QImage *im = papa->image(0);
-		if(im)
-			info = QString("Size: %1 x %2, Format: %3").arg(im->width()).arg(im->height()).arg(papa->format());
+		PapaFile *papa = Papas[index.row()].data();
+		if(papa->mipCount(0) > 0)
+			info = QString("Size: %1 x %2, Format: %3").arg(papa->size(0).width()).arg(papa->size(0).height()).arg(papa->format());
 		else
 			info = QString("Size: ?????, Format: %3").arg(papa->format());
+		if(papa->isSRGB(0))
+			info += ", sRGB";
 
 		return info;
 	}
@@ -125,8 +537,8 @@ bool TextureListModel::isEditable(const QModelIndex& index)
 {
 	if(index.row() < Papas.count())
 	{
-		PapaFile *papa = Papas[index.row()];
-		if(papa)
+		PapaFile *papa = Papas[index.row()].data();
+		if(papa && !Busy.contains(papa))
 		{
 			return papa->canEncode();
 		}
@@ -135,41 +547,103 @@ bool TextureListModel::isEditable(const QModelIndex& index)
 	return false;
 }
 
+bool TextureListModel::isBusy(const QModelIndex& index)
+{
+	return index.row() < Papas.count() && Busy.contains(Papas[index.row()].data());
+}
+
+void TextureListModel::cancelTasks()
+{
+	for(QSet<PapaFile *>::const_iterator papa = Busy.constBegin(); papa != Busy.constEnd(); ++papa)
+		(*papa)->cancel();
+}
+
 bool TextureListModel::importImage(const QString& name, const QModelIndex& index)
 {
-	if(!index.isValid() || !Papas[index.row()]->image(0))
+	if(!isEditable(index))
 		return false;
 
-	QImageReader *reader = new QImageReader(name);
-	QImage newimage = reader->read();
-	delete reader;
+	return startTask(ImportTask, index, name);
+}
 
-	if(Papas[index.row()]->size(0) == newimage.size() && Papas[index.row()]->canEncode())
-	{
-		return Papas[index.row()]->importImage(newimage, 0);
-	}
-	else
+bool TextureListModel::exportImage(const QModelIndex& index, const QString& filename)
+{
+	if(!index.isValid() || index.row() >= Papas.count() || isBusy(index))
 		return false;
+
+	return startTask(ExportTask, index, filename);
 }
 
 bool TextureListModel::savePapa(const QModelIndex& index, const QString& filename)
 {
-	if(!index.isValid())
+	if(!isEditable(index))
 		return false;
 
-	if(index.row() < Papas.count())
+	return startTask(SaveTask, index, filename.isEmpty() ? Papas[index.row()]->filename() : filename);
+}
+
+bool TextureListModel::startTask(Task task, const QModelIndex& index, const QString& filename)
+{
+	// The row stays locked until taskDone, the others can still be used.
+	QSharedPointer<PapaFile> papa = Papas[index.row()];
+	Busy.insert(papa.data());
+	papa->cancel(false);
+	connect(papa.data(), SIGNAL(progress(int, int)), SIGNAL(taskProgress(int, int)));
+	emit dataChanged(index, index);
+
+	Scheduler->start(new TaskJob(this, task, papa, filename), TaskScheduler::Edit, this);
+	return true;
+}
+
+void TextureListModel::taskDone(QObject* object, int task, const QString& filename, bool success, const QString& error)
+{
+	// The row may be gone, in which case the pointer can't be used anymore.
+	PapaTrace::Span span("finish task");
+	PapaFile *papa = static_cast<PapaFile *>(object);
+	Busy.remove(papa);
+	int row = -1;
+	for(int i = 0; i < Papas.count(); i++)
 	{
-		if(!Papas[index.row()]->save(filename))
+		if(Papas[i].data() == papa)
 		{
-			LastError = Papas[index.row()]->lastError();
-			return false;
+			row = i;
+			break;
 		}
 	}
-	else
-		return false;
 
-	LastError = "";
-	return true;
+	if(row >= 0)
+	{
+		disconnect(papa, SIGNAL(progress(int, int)), this, SIGNAL(taskProgress(int, int)));
+		papa->cancel(false);
+
+		if(success && task == SaveTask)
+		{
+			papa->markSaved(filename);
+
+			// Don't let the watcher reload our own changes.
+			updateStamp(filename);
+
+			// Saving under a new name can move the row.
+			QSharedPointer<PapaFile> shared = Papas.takeAt(row);
+			int newrow = lowerBound(filename);
+			Papas.insert(row, shared);
+			if(newrow != row && beginMoveRows(QModelIndex(), row, row, QModelIndex(), newrow > row ? newrow + 1 : newrow))
+			{
+				Papas.move(row, newrow);
+				endMoveRows();
+				row = newrow;
+			}
+		}
+		else if(success && task == ImportTask)
+			Thumbnails.remove(papa);
+
+		emit dataChanged(index(row), index(row));
+		if(success && task == ImportTask)
+			emit textureReplaced(index(row));
+	}
+
+	LastError = success ? "" : error;
+	emit taskFinished(task, success, error);
 }
 
 
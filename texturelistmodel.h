@@ -21,13 +21,32 @@
 #define TEXTURELISTMODEL_H
 
 #include <QAbstractItemModel>
+#include <QDateTime>
+#include <QHash>
+#include <QCache>
+#include <QPixmap>
+#include <QSharedPointer>
+#include <QSet>
 #include "papafile.h"
 
+class QFileSystemWatcher;
+class DirectoryScanner;
+class ThumbnailLoader;
+class TaskScheduler;
+class Prefetcher;
+
 class TextureListModel : public QAbstractListModel
 {
 	Q_OBJECT
 
 public:
+	enum Task
+	{
+		SaveTask,
+		ImportTask,
+		ExportTask
+	};
+
 	TextureListModel(QObject *parent = 0);
 	~TextureListModel();
 	virtual QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const;
@@ -35,16 +54,71 @@ public:
 	virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 
 	bool importImage(const QString& name, const QModelIndex& index);
+	bool exportImage(const QModelIndex& index, const QString& filename);
 	bool loadFromDirectory(const QString& foldername);
 	PapaFile *papa(const QModelIndex& index);
+	QSharedPointer<PapaFile> sharedPapa(const QModelIndex& index);
+	void prefetch(const QModelIndex& index);
 	QString info(const QModelIndex& index);
 	bool savePapa(const QModelIndex& index, const QString& filename = "");
 	QString lastError() {return LastError;}
 	bool isEditable(const QModelIndex& index);
+	bool isBusy(const QModelIndex& index);
+	void setWatching(bool watch);
+	bool isWatching() {return Watching;}
+	void setThumbnails(bool show);
+	QSize thumbnailSize();
+	TaskScheduler *scheduler() {return Scheduler;}
+
+public slots:
+	void cancelTasks();
+
+signals:
+	void taskProgress(int value, int maximum);
+	void taskFinished(int task, bool success, const QString& error);
+	void loadFinished();
+	void textureReplaced(const QModelIndex& index); // New contents, not just a new thumbnail or state
+
+private slots:
+	void directoryChanged(const QString& foldername);
+	void scannerBatchReady();
+	void scannerFinished();
+	void thumbnailReady(PapaFile *papa, const QString& filename, const QImage& thumbnail);
+	void taskDone(QObject *papa, int task, const QString& filename, bool success, const QString& error);
 
 private:
-	QList<PapaFile *> Papas;
+	struct filestamp_t
+	{
+		QDateTime LastModified;
+		qint64 Size;
+	};
+
+	PapaFile *loadPapa(const QString& filename);
+	int findPapa(const QString& filename);
+	int lowerBound(const QString& filename);
+	void insertPapa(PapaFile *papa);
+	void insertPapas(QList<PapaFile *> papas);
+	void removePapa(int row);
+	void reloadPapa(int row);
+	bool isChangedOnDisk(const QString& filename);
+	void updateStamp(const QString& filename);
+	void updateWatcher();
+	bool startTask(Task task, const QModelIndex& index, const QString& filename);
+
+	QList<QSharedPointer<PapaFile> > Papas;
 	QString LastError;
+	QString Folder;
+	bool Watching;
+	QFileSystemWatcher *Watcher;
+	QHash<QString, filestamp_t> Stamps;
+	DirectoryScanner *Scanner;
+	QStringList Directories;
+	bool ShowThumbnails;
+	ThumbnailLoader *Thumbnailer;
+	QCache<PapaFile *, QPixmap> Thumbnails;
+	TaskScheduler *Scheduler;
+	QSet<PapaFile *> Busy;
+	Prefetcher *Prefetch;
 };
 
 #endif // TEXTURELISTMODEL_H
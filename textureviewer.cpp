@@ -0,0 +1,231 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "textureviewer.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QScrollBar>
+#include <cmath>
+#include <algorithm>
+
+TextureViewer::TextureViewer(QWidget* parent)
+ : QAbstractScrollArea(parent), Zoom(1.0)
+{
+	// Tiles are charged in kilobytes.
+	Tiles.setMaxCost(128 * 1024);
+	horizontalScrollBar()->setSingleStep(TileSize / 8);
+	verticalScrollBar()->setSingleStep(TileSize / 8);
+	viewport()->setCursor(Qt::OpenHandCursor);
+}
+
+TextureViewer::~TextureViewer()
+{
+}
+
+void TextureViewer::clear()
+{
+	setTextureSize(QSize(), 0);
+}
+
+void TextureViewer::setTextureSize(const QSize& size, int mipcount)
+{
+	TextureSize = size;
+	Mipmaps.clear();
+	for(int m = 0; m < mipcount; m++)
+		Mipmaps.push_back(QImage());
+	Tiles.clear();
+
+	updateScrollBars();
+	viewport()->update();
+}
+
+void TextureViewer::setMipmap(int mipindex, const QImage& image)
+{
+	if(mipindex >= Mipmaps.count())
+		return;
+
+	Mipmaps[mipindex] = image;
+	Tiles.clear();
+	viewport()->update();
+}
+
+void TextureViewer::zoomIn()
+{
+	zoomAround(Zoom * 1.25, viewport()->rect().center());
+}
+
+void TextureViewer::zoomOut()
+{
+	zoomAround(Zoom / 1.25, viewport()->rect().center());
+}
+
+void TextureViewer::resetZoom()
+{
+	zoomAround(1.0, viewport()->rect().center());
+}
+
+void TextureViewer::zoomAround(double zoom, const QPoint& position)
+{
+	zoom = std::min(32.0, std::max(1.0 / 64, zoom));
+
+	// Keep the texel under the cursor where it is.
+	QPoint oldorigin = origin();
+	double texelx = (position.x() - oldorigin.x()) / Zoom;
+	double texely = (position.y() - oldorigin.y()) / Zoom;
+
+	Zoom = zoom;
+	updateScrollBars();
+	horizontalScrollBar()->setValue(qRound(texelx * Zoom) - position.x());
+	verticalScrollBar()->setValue(qRound(texely * Zoom) - position.y());
+	viewport()->update();
+}
+
+void TextureViewer::updateScrollBars()
+{
+	int width = qRound(TextureSize.width() * Zoom);
+	int height = qRound(TextureSize.height() * Zoom);
+
+	horizontalScrollBar()->setRange(0, std::max(0, width - viewport()->width()));
+	horizontalScrollBar()->setPageStep(viewport()->width());
+	verticalScrollBar()->setRange(0, std::max(0, height - viewport()->height()));
+	verticalScrollBar()->setPageStep(viewport()->height());
+}
+
+QPoint TextureViewer::origin()
+{
+	// Small textures are centred, big ones scroll.
+	int width = qRound(TextureSize.width() * Zoom);
+	int height = qRound(TextureSize.height() * Zoom);
+
+	return QPoint(
+		width < viewport()->width() ? (viewport()->width() - width) / 2 : -horizontalScrollBar()->value(),
+		height < viewport()->height() ? (viewport()->height() - height) / 2 : -verticalScrollBar()->value()
+	);
+}
+
+int TextureViewer::mipmapFor(double zoom)
+{
+	// Ideally one texel per pixel, so when zoomed out a smaller mipmap will
+	// do. Fall back to the closest one that is available, finer ones first.
+	if(Mipmaps.isEmpty())
+		return -1;
+
+	int wanted = 0;
+	if(zoom < 1.0)
+		wanted = std::min((int)std::floor(std::log(1.0 / zoom) / std::log(2.0)), Mipmaps.count() - 1);
+
+	for(int m = wanted; m >= 0; m--)
+	{
+		if(!Mipmaps[m].isNull())
+			return m;
+	}
+	for(int m = wanted + 1; m < Mipmaps.count(); m++)
+	{
+		if(!Mipmaps[m].isNull())
+			return m;
+	}
+
+	return -1;
+}
+
+void TextureViewer::paintEvent(QPaintEvent *event)
+{
+	int mipindex = mipmapFor(Zoom);
+	if(mipindex < 0)
+		return;
+
+	const QImage &image = Mipmaps[mipindex];
+	double scalex = Zoom * TextureSize.width() / image.width();
+	double scaley = Zoom * TextureSize.height() / image.height();
+	QPoint topleft = origin();
+
+	QPainter painter(viewport());
+	// Show the actual texels when zoomed in.
+	painter.setRenderHint(QPainter::SmoothPixmapTransform, scalex < 1.0 || scaley < 1.0);
+
+	// Only the tiles that intersect the exposed area are drawn, and only
+	// those get converted to pixmaps.
+	QRect exposed = event->rect();
+	int firsttilex = std::max(0, (int)std::floor((exposed.left() - topleft.x()) / scalex / TileSize));
+	int lasttilex = std::min((image.width() - 1) / TileSize, (int)std::floor((exposed.right() - topleft.x()) / scalex / TileSize));
+	int firsttiley = std::max(0, (int)std::floor((exposed.top() - topleft.y()) / scaley / TileSize));
+	int lasttiley = std::min((image.height() - 1) / TileSize, (int)std::floor((exposed.bottom() - topleft.y()) / scaley / TileSize));
+
+	for(int tiley = firsttiley; tiley <= lasttiley; tiley++)
+	{
+		for(int tilex = firsttilex; tilex <= lasttilex; tilex++)
+		{
+			QRect source = QRect(tilex * TileSize, tiley * TileSize, TileSize, TileSize) & image.rect();
+
+			quint64 key = ((quint64)mipindex << 48) | ((quint64)tilex << 24) | (quint64)tiley;
+			QPixmap *tile = Tiles.object(key);
+			if(!tile)
+			{
+				tile = new QPixmap(QPixmap::fromImage(image.copy(source)));
+				Tiles.insert(key, tile, std::max(1, source.width() * source.height() * 4 / 1024));
+			}
+
+			// Round the edges rather than the sizes, so neighbouring tiles
+			// line up without gaps.
+			QRect target;
+			target.setLeft(topleft.x() + qRound(source.left() * scalex));
+			target.setTop(topleft.y() + qRound(source.top() * scaley));
+			target.setRight(topleft.x() + qRound((source.right() + 1) * scalex) - 1);
+			target.setBottom(topleft.y() + qRound((source.bottom() + 1) * scaley) - 1);
+
+			painter.drawPixmap(target, *tile, tile->rect());
+		}
+	}
+}
+
+void TextureViewer::resizeEvent(QResizeEvent *event)
+{
+	QAbstractScrollArea::resizeEvent(event);
+	updateScrollBars();
+}
+
+void TextureViewer::wheelEvent(QWheelEvent *event)
+{
+	if(event->delta() > 0)
+		zoomAround(Zoom * 1.25, event->pos());
+	else if(event->delta() < 0)
+		zoomAround(Zoom / 1.25, event->pos());
+
+	event->accept();
+}
+
+void TextureViewer::mousePressEvent(QMouseEvent *event)
+{
+	DragStart = event->pos();
+	DragScroll = QPoint(horizontalScrollBar()->value(), verticalScrollBar()->value());
+}
+
+void TextureViewer::mouseMoveEvent(QMouseEvent *event)
+{
+	if(!(event->buttons() & Qt::LeftButton))
+		return;
+
+	QPoint distance = event->pos() - DragStart;
+	horizontalScrollBar()->setValue(DragScroll.x() - distance.x());
+	verticalScrollBar()->setValue(DragScroll.y() - distance.y());
+}
+
+#include "textureviewer.moc"
@@ -0,0 +1,68 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TEXTUREVIEWER_H
+#define TEXTUREVIEWER_H
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QImage>
+#include <QPixmap>
+
+class TextureViewer : public QAbstractScrollArea
+{
+	Q_OBJECT
+
+public:
+	TextureViewer(QWidget *parent = 0);
+	~TextureViewer();
+	void clear();
+	void setTextureSize(const QSize& size, int mipcount);
+	double zoom() {return Zoom;}
+
+public slots:
+	void setMipmap(int mipindex, const QImage& image);
+	void zoomIn();
+	void zoomOut();
+	void resetZoom();
+
+protected:
+	virtual void paintEvent(QPaintEvent *event);
+	virtual void resizeEvent(QResizeEvent *event);
+	virtual void wheelEvent(QWheelEvent *event);
+	virtual void mousePressEvent(QMouseEvent *event);
+	virtual void mouseMoveEvent(QMouseEvent *event);
+
+private:
+	void zoomAround(double zoom, const QPoint& position);
+	void updateScrollBars();
+	QPoint origin();
+	int mipmapFor(double zoom);
+
+	static const int TileSize = 256;
+
+	QSize TextureSize;
+	QList<QImage> Mipmaps;
+	double Zoom;
+	QCache<quint64, QPixmap> Tiles;
+	QPoint DragStart;
+	QPoint DragScroll;
+};
+
+#endif // TEXTUREVIEWER_H
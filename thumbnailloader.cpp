@@ -0,0 +1,120 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "thumbnailloader.h"
+#include "papafile.h"
+#include "taskscheduler.h"
+#include <QRunnable>
+
+class ThumbnailJob : public QRunnable
+{
+public:
+	ThumbnailJob(ThumbnailLoader *loader, QSharedPointer<PapaFile> papa, const QSize& size)
+	 : Loader(loader), Papa(papa), Filename(papa->filename()), Size(size)
+	{
+	}
+
+	virtual void run()
+	{
+		// Decode only the smallest mipmap that is still big enough.
+		QImage thumbnail;
+		QImage image = Papa->mipmap(0, Papa->mipmapFor(0, Size));
+		if(!image.isNull())
+			thumbnail = image.scaled(Size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+		QMetaObject::invokeMethod(Loader, "jobFinished", Qt::QueuedConnection, Q_ARG(QObject *, Papa.data()), Q_ARG(QString, Filename), Q_ARG(QImage, thumbnail));
+	}
+
+private:
+	ThumbnailLoader *Loader;
+	QSharedPointer<PapaFile> Papa;
+	QString Filename;
+	QSize Size;
+};
+
+ThumbnailLoader::ThumbnailLoader(TaskScheduler *scheduler, const QSize& size, QObject* parent)
+ : QObject(parent), Size(size), Scheduler(scheduler), MaximumPending(256)
+{
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+	Pending.clear();
+	Scheduler->cancel(this);
+	Scheduler->waitForDone(this);
+}
+
+void ThumbnailLoader::request(QSharedPointer<PapaFile> papa)
+{
+	if(Running.contains(papa.data()))
+		return;
+
+	// Whatever was asked for last is most likely still on screen, so it goes
+	// first. Old requests for rows that scrolled out of view fall off the end.
+	Pending.removeAll(papa);
+	Pending.push_front(papa);
+	while(Pending.count() > MaximumPending)
+		Pending.pop_back();
+
+	startJobs();
+}
+
+void ThumbnailLoader::clear()
+{
+	Pending.clear();
+}
+
+void ThumbnailLoader::cancel(PapaFile *papa)
+{
+	// The row is gone, so nobody is waiting for this one anymore.
+	for(int i = 0; i < Pending.count(); i++)
+	{
+		if(Pending[i].data() == papa)
+		{
+			Pending.removeAt(i);
+			break;
+		}
+	}
+	if(Scheduler->cancel(this, papa) > 0)
+	{
+		Running.remove(papa);
+		startJobs();
+	}
+}
+
+void ThumbnailLoader::startJobs()
+{
+	// Only hand the scheduler a few at a time, so the most recent requests
+	// can still overtake the older ones here.
+	while(!Pending.isEmpty() && Running.count() < Scheduler->threadCount())
+	{
+		QSharedPointer<PapaFile> papa = Pending.takeFirst();
+		Running.insert(papa.data());
+		Scheduler->start(new ThumbnailJob(this, papa, Size), TaskScheduler::Thumbnail, this, papa.data());
+	}
+}
+
+void ThumbnailLoader::jobFinished(QObject *papa, const QString& filename, const QImage& thumbnail)
+{
+	Running.remove((PapaFile *)papa);
+	emit thumbnailReady((PapaFile *)papa, filename, thumbnail);
+	startJobs();
+}
+
+#include "thumbnailloader.moc"
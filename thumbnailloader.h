@@ -0,0 +1,59 @@
+/*
+ * <one line to give the program's name and a brief idea of what it does.>
+ * Copyright (C) 2014  Jarno van der Kolk <jarno@jarno.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+
+#include <QObject>
+#include <QImage>
+#include <QSharedPointer>
+#include <QSet>
+
+class PapaFile;
+class TaskScheduler;
+
+class ThumbnailLoader : public QObject
+{
+	Q_OBJECT
+
+public:
+	ThumbnailLoader(TaskScheduler *scheduler, const QSize& size, QObject *parent = 0);
+	~ThumbnailLoader();
+	void request(QSharedPointer<PapaFile> papa);
+	void clear();
+	void cancel(PapaFile *papa);
+	QSize size() {return Size;}
+
+signals:
+	void thumbnailReady(PapaFile *papa, const QString& filename, const QImage& thumbnail);
+
+private slots:
+	void jobFinished(QObject *papa, const QString& filename, const QImage& thumbnail);
+
+private:
+	void startJobs();
+
+	QSize Size;
+	QList<QSharedPointer<PapaFile> > Pending; // Most recent request first
+	QSet<PapaFile *> Running;
+	TaskScheduler *Scheduler;
+	int MaximumPending;
+};
+
+#endif // THUMBNAILLOADER_H